@@ -0,0 +1,81 @@
+#!/bin/sh
+###########################################################################
+##  Benchmark of plsa on synthetic co-occurrence files written by plsa-gen.
+##
+##  Usage:  bench.sh <plsa> <plsa-gen> [work directory]
+##
+##  The grid is set through the environment:
+##    BENCH_SIZES       rows x columns x density of each file
+##                      (Default:  "500x1000x0.02 1000x2000x0.01")
+##    BENCH_CLUSTERS    numbers of clusters  (Default:  "8 16")
+##    BENCH_ITERATIONS  EM iterations of each run  (Default:  10)
+##    BENCH_THREADS     --threads of each run  (Default:  1)
+##    BENCH_SEED        seed of plsa-gen and plsa  (Default:  1)
+##
+##  One tab-separated line is written per run, after a header, with the
+##  seconds spent in each phase (from --profile) and the throughput of
+##  the EM iterations.  The work directory (a temporary one by default)
+##  holds the generated files and the output of each run.
+###########################################################################
+
+PLSA="$1"
+PLSA_GEN="$2"
+WORK_DIR="$3"
+
+if [ -z "$PLSA" ] || [ -z "$PLSA_GEN" ]; then
+  echo "Usage:  $0 <plsa> <plsa-gen> [work directory]" >&2
+  exit 1
+fi
+
+SIZES="${BENCH_SIZES:-500x1000x0.02 1000x2000x0.01}"
+CLUSTERS="${BENCH_CLUSTERS:-8 16}"
+ITERATIONS="${BENCH_ITERATIONS:-10}"
+THREADS="${BENCH_THREADS:-1}"
+SEED="${BENCH_SEED:-1}"
+
+REMOVE_WORK_DIR=0
+if [ -z "$WORK_DIR" ]; then
+  WORK_DIR=`mktemp -d`
+  REMOVE_WORK_DIR=1
+fi
+mkdir -p "$WORK_DIR"
+
+##  Value of a number in the --profile report, found by its indented key
+profileValue () {
+  sed -n "s/^$2\"$3\": \([0-9.e+-]*\),*\$/\1/p" "$1"
+}
+
+printf "rows\tcolumns\tdensity\tnonzeros\tclusters\tthreads\titerations\tread\tinit\tml\te_step\tm_step\tnormalize\toutput\ttotal\titerations_per_sec\tnonzeros_per_sec\n"
+
+for SIZE in $SIZES; do
+  ROWS=`echo "$SIZE" | cut -d x -f 1`
+  COLUMNS=`echo "$SIZE" | cut -d x -f 2`
+  DENSITY=`echo "$SIZE" | cut -d x -f 3`
+  CO_FN="$WORK_DIR/bench-$SIZE.cooccur"
+
+  if [ ! -f "$CO_FN" ]; then
+    "$PLSA_GEN" --output "$CO_FN" --rows "$ROWS" --columns "$COLUMNS" --density "$DENSITY" --seed "$SEED" 2>/dev/null || exit 1
+  fi
+
+  for K in $CLUSTERS; do
+    BASE="$WORK_DIR/bench-$SIZE-k$K"
+    "$PLSA" --cooccur "$CO_FN" --base "$BASE" --clusters "$K" --seed "$SEED" --maxiter "$ITERATIONS" --rtol 0 --threads "$THREADS" --profile "$BASE.json" 2>/dev/null || exit 1
+
+    P="$BASE.json"
+    printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" \
+      "$ROWS" "$COLUMNS" "$DENSITY" "`profileValue $P '  ' nonzeros`" "$K" "$THREADS" "`profileValue $P '  ' steps`" \
+      "`profileValue $P '    ' read`" "`profileValue $P '    ' initialize`" "`profileValue $P '    ' log_likelihood`" \
+      "`profileValue $P '    ' e_step`" "`profileValue $P '    ' m_step`" "`profileValue $P '    ' normalize`" \
+      "`profileValue $P '    ' output`" "`profileValue $P '  ' seconds`" | \
+    awk -F '\t' 'BEGIN { OFS = "\t" } {
+      em = $10 + $11 + $12 + $13;
+      printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%.6f\t%.6f\t%.6f\t%.6f\t%.6f\t%.6f\t%.6f\t%.6f\t%.3f\t%.1f\n", \
+        $1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13, $14, $15, \
+        (em > 0) ? $7 / em : 0, (em > 0) ? $4 * $7 / em : 0
+    }'
+  done
+done
+
+if [ $REMOVE_WORK_DIR -eq 1 ]; then
+  rm -rf "$WORK_DIR"
+fi
@@ -0,0 +1,82 @@
+#!/bin/sh
+###########################################################################
+##  Numerical regression of the EM engines against the serial reference.
+##
+##  Usage:  regress.sh <plsa> <plsa-gen> <plsa-compare> [work directory]
+##
+##  A co-occurrence file is generated and a model is trained on it with
+##  the reference engine (serial batch EM) and with each engine that
+##  should reproduce it, with the same seed and a fixed number of
+##  iterations.  plsa-compare checks the probabilities and the
+##  log-likelihood after each iteration of each against the reference.
+##  Settings come from the environment:
+##    REGRESS_SIZE        rows x columns x density  (Default:  "400x600x0.02")
+##    REGRESS_CLUSTERS    number of clusters  (Default:  8)
+##    REGRESS_ITERATIONS  EM iterations  (Default:  20)
+##    REGRESS_SEED        seed of plsa-gen and plsa  (Default:  1)
+##    REGRESS_TOLERANCE   passed to plsa-compare --tolerance
+##                        and --ml-tolerance  (Default:  1e-6)
+##  --sparse 5 refreshes the full posteriors every fifth iteration and
+##  updates only the active clusters of each nonzero in between, so both
+##  of its paths are checked.  --minibatch and --accelerate are left out:
+##  online EM and SQUAREM take different steps from batch EM by design,
+##  so their parameters after a fixed number of iterations are not
+##  expected to match the reference at any useful tolerance.
+##  The exit status is 1 if any engine fails.
+###########################################################################
+
+PLSA="$1"
+PLSA_GEN="$2"
+PLSA_COMPARE="$3"
+WORK_DIR="$4"
+
+if [ -z "$PLSA" ] || [ -z "$PLSA_GEN" ] || [ -z "$PLSA_COMPARE" ]; then
+  echo "Usage:  $0 <plsa> <plsa-gen> <plsa-compare> [work directory]" >&2
+  exit 1
+fi
+
+SIZE="${REGRESS_SIZE:-400x600x0.02}"
+CLUSTERS="${REGRESS_CLUSTERS:-8}"
+ITERATIONS="${REGRESS_ITERATIONS:-20}"
+SEED="${REGRESS_SEED:-1}"
+TOLERANCE="${REGRESS_TOLERANCE:-1e-6}"
+
+##  Engines compared with the reference, as name:options
+ENGINES="threads:--threads=4 sparse:--sparse=5 stream:--stream"
+
+REMOVE_WORK_DIR=0
+if [ -z "$WORK_DIR" ]; then
+  WORK_DIR=`mktemp -d`
+  REMOVE_WORK_DIR=1
+fi
+mkdir -p "$WORK_DIR"
+
+CO_FN="$WORK_DIR/regress.cooccur"
+"$PLSA_GEN" --output "$CO_FN" --rows `echo "$SIZE" | cut -d x -f 1` --columns `echo "$SIZE" | cut -d x -f 2` \
+  --density `echo "$SIZE" | cut -d x -f 3` --seed "$SEED" 2>/dev/null || exit 1
+
+trainModel () {
+  "$PLSA" --cooccur "$CO_FN" --base "$WORK_DIR/$1" --clusters "$CLUSTERS" --seed "$SEED" --maxiter "$ITERATIONS" \
+    --rtol 0 --nooutput --profile "$WORK_DIR/$1.csv" $2 2>/dev/null
+}
+
+trainModel reference "" || exit 1
+
+FAILED=0
+for ENGINE in $ENGINES; do
+  NAME=`echo "$ENGINE" | cut -d : -f 1`
+  OPTIONS=`echo "$ENGINE" | cut -d : -f 2 | tr '=' ' '`
+  printf "%-10s" "$NAME"
+  if ! trainModel "$NAME" "$OPTIONS"; then
+    echo "FAIL	training failed"
+    FAILED=1
+    continue
+  fi
+  "$PLSA_COMPARE" --tolerance "$TOLERANCE" --ml-tolerance "$TOLERANCE" "$WORK_DIR/reference" "$WORK_DIR/$NAME" || FAILED=1
+done
+
+if [ $REMOVE_WORK_DIR -eq 1 ]; then
+  rm -rf "$WORK_DIR"
+fi
+
+exit $FAILED
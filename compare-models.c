@@ -0,0 +1,336 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*!
+**  Numerical comparison of two trained models (plsa-compare), for
+**  checking that an engine reproduces the reference one.  Each model is
+**  given by its base filename:  <base>.model is read (binary unless
+**  --text is given) and, if both runs wrote one with --profile,
+**  <base>.csv supplies the log-likelihood after each iteration.  The
+**  probabilities must agree within --tolerance (absolute, on P rather
+**  than log P) and the log-likelihoods within --ml-tolerance (relative).
+**  The exit status is 0 if they do and 1 if not.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "wmalloc.h"
+
+/*!  Default largest difference allowed between two probabilities  */
+#define COMPARE_TOLERANCE 1e-9
+
+/*!  Default largest relative difference allowed between two log-likelihoods  */
+#define COMPARE_ML_TOLERANCE 1e-9
+
+/*!  Longest line of a --profile CSV file  */
+#define COMPARE_LINE_LENGTH 1024
+
+
+typedef struct compare_model {
+  unsigned int num_clusters;
+  unsigned int m;
+  unsigned int n;
+  unsigned int *row_ids;
+  unsigned int *column_ids;
+  /*!  P(z), P(w1|z) and P(w2|z) one after the other, as log values  */
+  double *probs;
+  /*!  Log-likelihood after each iteration, from the --profile CSV file  */
+  double *ML;
+  unsigned int num_ML;
+} COMPARE_MODEL;
+
+
+static void usage (char *progname) {
+  fprintf (stderr, "Comparison of two PLSA models\n");
+  fprintf (stderr, "=============================\n\n");
+  fprintf (stderr, "Usage:  %s [options] <reference base> <candidate base>\n\n", progname);
+  fprintf (stderr, "Options:\n");
+  fprintf (stderr, "--tolerance <float>:  Largest difference allowed between probabilities.\n");
+  fprintf (stderr, "                   :    (Default:  %g).\n", COMPARE_TOLERANCE);
+  fprintf (stderr, "--ml-tolerance <float>:  Largest relative difference allowed between\n");
+  fprintf (stderr, "                   :    log-likelihoods.  (Default:  %g).\n", COMPARE_ML_TOLERANCE);
+  fprintf (stderr, "--text             :  The model files are in text.\n");
+
+  exit (EXIT_FAILURE);
+}
+
+
+static bool readValue (FILE *fp, bool textio, unsigned int *value) {
+  if (textio) {
+    return (fscanf (fp, "%u", value) == 1);
+  }
+  return (fread (value, sizeof (unsigned int), 1, fp) == 1);
+}
+
+
+/*!
+**  Read the model written by printModel (), with the same checks as
+**  readModel ():  every value must be read, the header must not be empty
+**  and the size of the file must fit the header before anything is
+**  allocated for it.
+*/
+static bool readCompareModel (COMPARE_MODEL *model, const char *base, bool textio) {
+  FILE *fp = NULL;
+  char *fn = wmalloc (strlen (base) + 10);
+  const char *problem = NULL;
+  size_t size = 0;
+  size_t i = 0;
+  long file_size = 0;
+
+  sprintf (fn, "%s.model", base);
+  fp = fopen (fn, textio ? "r" : "rb");
+  if (fp == NULL) {
+    fprintf (stderr, "Error opening %s.\n", fn);
+    wfree (fn);
+    return false;
+  }
+  fseek (fp, 0, SEEK_END);
+  file_size = ftell (fp);
+  rewind (fp);
+
+  model -> row_ids = NULL;
+  model -> column_ids = NULL;
+  model -> probs = NULL;
+  if ((!readValue (fp, textio, &(model -> num_clusters))) || (!readValue (fp, textio, &(model -> m))) || (!readValue (fp, textio, &(model -> n)))) {
+    problem = textio ? "has no header in text; if it is binary, leave out --text" : "is too short to have a header";
+  }
+  else if ((model -> num_clusters == 0) || (model -> m == 0) || (model -> n == 0)) {
+    problem = "has no clusters, rows or columns";
+  }
+  else {
+    size = (size_t) model -> num_clusters * (1 + (size_t) model -> m + model -> n);
+    /*  In text, each value takes at least one digit and one separator  */
+    if ((textio) && (2.0 * (3.0 + model -> m + model -> n + (double) size) - 1.0 > (double) file_size)) {
+      problem = "is too short for its header; if it is binary, leave out --text";
+    }
+    if ((!textio) && ((double) sizeof (unsigned int) * (3.0 + model -> m + model -> n) + (double) sizeof (double) * (double) size != (double) file_size)) {
+      problem = "does not have the size its header calls for; if it is text, add --text";
+    }
+  }
+
+  if (problem == NULL) {
+    model -> row_ids = wmalloc ((model -> m + 1) * sizeof (unsigned int));
+    model -> column_ids = wmalloc ((model -> n + 1) * sizeof (unsigned int));
+    model -> probs = wmalloc ((size + 1) * sizeof (double));
+    for (i = 0; (i < model -> m) && (problem == NULL); i++) {
+      if (!readValue (fp, textio, &(model -> row_ids[i]))) {
+        problem = "has a missing or malformed row id";
+      }
+    }
+    for (i = 0; (i < model -> n) && (problem == NULL); i++) {
+      if (!readValue (fp, textio, &(model -> column_ids[i]))) {
+        problem = "has a missing or malformed column id";
+      }
+    }
+    if ((problem == NULL) && (textio)) {
+      for (i = 0; (i < size) && (problem == NULL); i++) {
+        if (fscanf (fp, "%lf", &(model -> probs[i])) != 1) {
+          problem = "has a missing or malformed probability";
+        }
+      }
+    }
+    if ((problem == NULL) && (!textio) && (fread (model -> probs, sizeof (double), size, fp) != size)) {
+      problem = "is truncated";
+    }
+  }
+  fclose (fp);
+
+  if (problem != NULL) {
+    fprintf (stderr, "Model file %s %s.\n", fn, problem);
+    wfree (model -> row_ids);
+    wfree (model -> column_ids);
+    wfree (model -> probs);
+    wfree (fn);
+    return false;
+  }
+  wfree (fn);
+
+  return true;
+}
+
+
+/*!  Read the log-likelihoods from <base>.csv, if there is one  */
+static void readTrajectory (COMPARE_MODEL *model, const char *base) {
+  FILE *fp = NULL;
+  char *fn = wmalloc (strlen (base) + 10);
+  char line[COMPARE_LINE_LENGTH];
+  char *field = NULL;
+  unsigned int capacity = 64;
+  unsigned int f = 0;
+
+  model -> ML = NULL;
+  model -> num_ML = 0;
+
+  sprintf (fn, "%s.csv", base);
+  fp = fopen (fn, "r");
+  wfree (fn);
+  if (fp == NULL) {
+    return;
+  }
+
+  model -> ML = wmalloc (capacity * sizeof (double));
+  /*  Skip the header; the log-likelihood is the tenth field  */
+  fgets (line, COMPARE_LINE_LENGTH, fp);
+  while (fgets (line, COMPARE_LINE_LENGTH, fp) != NULL) {
+    field = line;
+    for (f = 1; (f < 10) && (field != NULL); f++) {
+      field = strchr (field, ',');
+      if (field != NULL) {
+        field++;
+      }
+    }
+    if (model -> num_ML == capacity) {
+      capacity *= 2;
+      model -> ML = wrealloc (model -> ML, capacity * sizeof (double));
+    }
+    /*  Iterations without a log-likelihood are kept as NAN  */
+    model -> ML[model -> num_ML++] = ((field != NULL) && (*field != ',')) ? atof (field) : NAN;
+  }
+  fclose (fp);
+
+  return;
+}
+
+
+static void freeCompareModel (COMPARE_MODEL *model) {
+  wfree (model -> row_ids);
+  wfree (model -> column_ids);
+  wfree (model -> probs);
+  if (model -> ML != NULL) {
+    wfree (model -> ML);
+  }
+
+  return;
+}
+
+
+/*!  Largest difference between exp (a[i]) and exp (b[i])  */
+static double largestDifference (const double *a, const double *b, size_t count) {
+  double diff = 0.0;
+  double largest = 0.0;
+  unsigned int i = 0;
+
+  for (i = 0; i < count; i++) {
+    diff = fabs (exp (a[i]) - exp (b[i]));
+    if (diff > largest) {
+      largest = diff;
+    }
+  }
+
+  return (largest);
+}
+
+
+int main (int argc, char *argv[]) {
+  COMPARE_MODEL ref;
+  COMPARE_MODEL cand;
+  double tolerance = COMPARE_TOLERANCE;
+  double ml_tolerance = COMPARE_ML_TOLERANCE;
+  double diff_z = 0.0;
+  double diff_w1 = 0.0;
+  double diff_w2 = 0.0;
+  double diff_ML = 0.0;
+  double diff = 0.0;
+  bool textio = false;
+  bool pass = true;
+  unsigned int k = 0;
+  unsigned int i = 0;
+  int c = 0;
+  int option_index = 0;
+  static struct option long_options[] = {
+    {"tolerance", 1, 0, 0},
+    {"ml-tolerance", 1, 0, 0},
+    {"text", 0, 0, 0},
+    {NULL, 0, NULL, 0}
+  };
+
+  while (true) {
+    c = getopt_long (argc, argv, "", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    if (c != 0) {
+      usage (argv[0]);
+    }
+    if (strcmp (long_options[option_index].name, "tolerance") == 0) {
+      tolerance = atof (optarg);
+    }
+    else if (strcmp (long_options[option_index].name, "ml-tolerance") == 0) {
+      ml_tolerance = atof (optarg);
+    }
+    else if (strcmp (long_options[option_index].name, "text") == 0) {
+      textio = true;
+    }
+  }
+  if (argc - optind != 2) {
+    usage (argv[0]);
+  }
+
+  if ((!readCompareModel (&ref, argv[optind], textio)) || (!readCompareModel (&cand, argv[optind + 1], textio))) {
+    return (EXIT_FAILURE);
+  }
+  readTrajectory (&ref, argv[optind]);
+  readTrajectory (&cand, argv[optind + 1]);
+
+  if ((ref.num_clusters != cand.num_clusters) || (ref.m != cand.m) || (ref.n != cand.n)) {
+    printf ("FAIL\tsize\t%u x %u x %u\t%u x %u x %u\n", ref.num_clusters, ref.m, ref.n, cand.num_clusters, cand.m, cand.n);
+    return (EXIT_FAILURE);
+  }
+  if ((memcmp (ref.row_ids, cand.row_ids, ref.m * sizeof (unsigned int)) != 0) ||
+      (memcmp (ref.column_ids, cand.column_ids, ref.n * sizeof (unsigned int)) != 0)) {
+    printf ("FAIL\tidentifiers differ\n");
+    return (EXIT_FAILURE);
+  }
+
+  k = ref.num_clusters;
+  diff_z = largestDifference (ref.probs, cand.probs, k);
+  diff_w1 = largestDifference (ref.probs + k, cand.probs + k, (size_t) k * ref.m);
+  diff_w2 = largestDifference (ref.probs + (size_t) k * (1 + ref.m), cand.probs + (size_t) k * (1 + ref.m), (size_t) k * ref.n);
+  pass = (diff_z <= tolerance) && (diff_w1 <= tolerance) && (diff_w2 <= tolerance);
+
+  /*  Both trajectories must be there and of the same length to be compared  */
+  if ((ref.ML != NULL) && (cand.ML != NULL)) {
+    if (ref.num_ML != cand.num_ML) {
+      pass = false;
+    }
+    for (i = 0; (i < ref.num_ML) && (i < cand.num_ML); i++) {
+      if ((isnan (ref.ML[i])) || (isnan (cand.ML[i]))) {
+        continue;
+      }
+      diff = fabs (ref.ML[i] - cand.ML[i]) / fabs (ref.ML[i]);
+      if (diff > diff_ML) {
+        diff_ML = diff;
+      }
+    }
+    pass = pass && (diff_ML <= ml_tolerance);
+    printf ("%s\tP(z) %.3g\tP(w1|z) %.3g\tP(w2|z) %.3g\tlog-likelihood %.3g (%u / %u iterations)\n", pass ? "PASS" : "FAIL", diff_z, diff_w1, diff_w2, diff_ML, ref.num_ML, cand.num_ML);
+  }
+  else {
+    printf ("%s\tP(z) %.3g\tP(w1|z) %.3g\tP(w2|z) %.3g\n", pass ? "PASS" : "FAIL", diff_z, diff_w1, diff_w2);
+  }
+
+  freeCompareModel (&ref);
+  freeCompareModel (&cand);
+
+  return (pass ? EXIT_SUCCESS : EXIT_FAILURE);
+}
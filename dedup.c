@@ -0,0 +1,418 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+**  Merging of identical rows and columns.  Rows with the same nonzeros
+**  and counts are replaced by one row whose counts are multiplied by the
+**  number of rows it stands for, and then the same is done for the
+**  columns.  EM on the merged data gives each merged row (column) the
+**  sum of the probabilities of the rows (columns) it stands for, so the
+**  probabilities are expanded again by dividing them evenly.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>                                  /*  UINT_MAX  */
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+
+#include "wmalloc.h"
+#include "plsa-defn.h"
+#include "dedup.h"
+
+
+/*!  A row or column and the hash of its nonzeros  */
+typedef struct hashed {
+  uint64_t hash;
+  unsigned int pos;
+} HASHED;
+
+
+/*!  Nonzeros of a column:  the kept rows and their counts  */
+typedef struct column_entry {
+  unsigned int row;
+  PROBNODE x;
+} COLUMN_ENTRY;
+
+
+/*!  FNV-1a over a block of memory  */
+static uint64_t hashBytes (uint64_t hash, const void *data, size_t size) {
+  const unsigned char *bytes = (const unsigned char*) data;
+
+  for (size_t b = 0; b < size; b++) {
+    hash ^= bytes[b];
+    hash *= UINT64_C(1099511628211);
+  }
+
+  return (hash);
+}
+
+
+/*!  Order by hash and then by position, so the first of a group comes first  */
+static int compareHashed (const void *a, const void *b) {
+  const HASHED *p = (const HASHED*) a;
+  const HASHED *q = (const HASHED*) b;
+
+  if (p -> hash != q -> hash) {
+    return ((p -> hash < q -> hash) ? -1 : 1);
+  }
+  if (p -> pos != q -> pos) {
+    return ((p -> pos < q -> pos) ? -1 : 1);
+  }
+
+  return (0);
+}
+
+
+static bool sameRow (const COOCCUR *a, const COOCCUR *b) {
+  if (a[0].column != b[0].column) {
+    return false;
+  }
+  for (unsigned int pos = 1; pos <= a[0].column; pos++) {
+    if ((a[pos].column != b[pos].column) || (a[pos].x != b[pos].x)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+static bool sameColumn (const COLUMN_ENTRY *a, unsigned int a_count, const COLUMN_ENTRY *b, unsigned int b_count) {
+  if (a_count != b_count) {
+    return false;
+  }
+  for (unsigned int pos = 0; pos < a_count; pos++) {
+    if ((a[pos].row != b[pos].row) || (a[pos].x != b[pos].x)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+/*!
+**  Group equal items given their hashes.  group[i] is set to the first
+**  item equal to i and the number of groups is returned.  same () is
+**  only called for items with the same hash.
+*/
+static unsigned int groupItems (HASHED *hashed, unsigned int count, unsigned int *group, bool (*same) (void *, unsigned int, unsigned int), void *data) {
+  unsigned int run = 0;  /*  Start of the items with the current hash  */
+  unsigned int groups = 0;
+  unsigned int a;
+  unsigned int b;
+
+  qsort (hashed, count, sizeof (HASHED), compareHashed);
+
+  for (a = 0; a < count; a++) {
+    if (hashed[a].hash != hashed[run].hash) {
+      run = a;
+    }
+    group[hashed[a].pos] = hashed[a].pos;
+    /*  Compare with the first item of each group seen with this hash  */
+    for (b = run; b < a; b++) {
+      if ((group[hashed[b].pos] == hashed[b].pos) && (same (data, hashed[a].pos, hashed[b].pos))) {
+        group[hashed[a].pos] = hashed[b].pos;
+        break;
+      }
+    }
+    if (group[hashed[a].pos] == hashed[a].pos) {
+      groups++;
+    }
+  }
+
+  return (groups);
+}
+
+
+static bool sameRowCallback (void *data, unsigned int a, unsigned int b) {
+  COOCCUR **cos = (COOCCUR**) data;
+
+  return (sameRow (cos[a], cos[b]));
+}
+
+
+/*!  Columns as lists of nonzeros, with their starting positions  */
+typedef struct columns {
+  COLUMN_ENTRY *entries;
+  size_t *start;
+} COLUMNS;
+
+
+static bool sameColumnCallback (void *data, unsigned int a, unsigned int b) {
+  COLUMNS *columns = (COLUMNS*) data;
+
+  return (sameColumn (columns -> entries + columns -> start[a], columns -> start[a + 1] - columns -> start[a], columns -> entries + columns -> start[b], columns -> start[b + 1] - columns -> start[b]));
+}
+
+
+/*!
+**  Number the groups in the order of their first item:  on return,
+**  group[i] is the new index of the group of item i and weight[g] is the
+**  log of the size of group g.  Returns the items that were kept.
+*/
+static unsigned int *numberGroups (unsigned int *group, unsigned int count, unsigned int groups, PROBNODE **weight) {
+  unsigned int *kept = wmalloc (groups * sizeof (unsigned int));
+  unsigned int *size = wmalloc (groups * sizeof (unsigned int));
+  unsigned int g = 0;
+  unsigned int i;
+
+  for (i = 0; i < count; i++) {
+    if (group[i] == i) {
+      kept[g] = i;
+      size[g] = 0;
+      group[i] = g++;
+    }
+    else {
+      /*  The first item of a group always comes before the others  */
+      group[i] = group[group[i]];
+    }
+    size[group[i]]++;
+  }
+
+  *weight = wmalloc (groups * sizeof (PROBNODE));
+  for (g = 0; g < groups; g++) {
+    (*weight)[g] = log ((double) size[g]);
+  }
+  wfree (size);
+
+  return (kept);
+}
+
+
+/*!
+**  Merge identical rows and then identical columns of the co-occurrence
+**  data that has just been read.  info is left with the merged data and
+**  (info -> dedup) records how to expand the probabilities again.
+*/
+void dedupCO (INFO *info) {
+  DEDUP *dedup = wmalloc (sizeof (DEDUP));
+  HASHED *hashed = NULL;
+  COLUMNS columns;
+  unsigned int *kept_rows = NULL;
+  unsigned int *kept_columns = NULL;
+  size_t *fill = NULL;
+  unsigned int num_rows = 0;
+  unsigned int num_columns = 0;
+  unsigned long old_nonzeros = 0;
+  unsigned long new_nonzeros = 0;
+  unsigned int cos_count;
+  unsigned int count;
+  unsigned int pos;
+  size_t p;
+  unsigned int r;
+  unsigned int i;
+  unsigned int j;
+  COOCCUR **cos = NULL;
+  COOCCUR *row = NULL;
+  struct timespec start;
+  struct timespec end;
+
+  GET_TIME (start);
+
+  dedup -> m = info -> m;
+  dedup -> n = info -> n;
+  dedup -> row_ids = info -> row_ids;
+  dedup -> column_ids = info -> column_ids;
+  dedup -> row_group = wmallocTag (info -> m * sizeof (unsigned int), WM_TAG_INDEX);
+  dedup -> column_group = wmallocTag (info -> n * sizeof (unsigned int), WM_TAG_INDEX);
+
+  /*  Rows  */
+  hashed = wmalloc (info -> m * sizeof (HASHED));
+  for (i = 0; i < info -> m; i++) {
+    cos_count = info -> cos[i][0].column;
+    old_nonzeros += cos_count;
+    hashed[i].pos = i;
+    hashed[i].hash = UINT64_C(14695981039346656037);
+    hashed[i].hash = hashBytes (hashed[i].hash, &cos_count, sizeof (unsigned int));
+    for (pos = 1; pos <= cos_count; pos++) {
+      hashed[i].hash = hashBytes (hashed[i].hash, &(info -> cos[i][pos].column), sizeof (unsigned int));
+      hashed[i].hash = hashBytes (hashed[i].hash, &(info -> cos[i][pos].x), sizeof (PROBNODE));
+    }
+  }
+  num_rows = groupItems (hashed, info -> m, dedup -> row_group, sameRowCallback, info -> cos);
+  wfree (hashed);
+  kept_rows = numberGroups (dedup -> row_group, info -> m, num_rows, &(dedup -> row_weight));
+
+  /*  Columns, over the kept rows only  */
+  columns.start = wmalloc ((info -> n + 1) * sizeof (size_t));
+  for (j = 0; j <= info -> n; j++) {
+    columns.start[j] = 0;
+  }
+  for (r = 0; r < num_rows; r++) {
+    row = info -> cos[kept_rows[r]];
+    for (pos = 1; pos <= row[0].column; pos++) {
+      columns.start[row[pos].column + 1]++;
+    }
+  }
+  for (j = 0; j < info -> n; j++) {
+    columns.start[j + 1] += columns.start[j];
+  }
+  columns.entries = wmalloc ((columns.start[info -> n] + 1) * sizeof (COLUMN_ENTRY));
+  fill = wmalloc (info -> n * sizeof (size_t));
+  memcpy (fill, columns.start, info -> n * sizeof (size_t));
+  for (r = 0; r < num_rows; r++) {
+    row = info -> cos[kept_rows[r]];
+    for (pos = 1; pos <= row[0].column; pos++) {
+      columns.entries[fill[row[pos].column]].row = r;
+      columns.entries[fill[row[pos].column]].x = row[pos].x;
+      fill[row[pos].column]++;
+    }
+  }
+  wfree (fill);
+
+  hashed = wmalloc (info -> n * sizeof (HASHED));
+  for (j = 0; j < info -> n; j++) {
+    count = columns.start[j + 1] - columns.start[j];
+    hashed[j].pos = j;
+    hashed[j].hash = UINT64_C(14695981039346656037);
+    hashed[j].hash = hashBytes (hashed[j].hash, &count, sizeof (unsigned int));
+    for (p = columns.start[j]; p < columns.start[j + 1]; p++) {
+      hashed[j].hash = hashBytes (hashed[j].hash, &(columns.entries[p].row), sizeof (unsigned int));
+      hashed[j].hash = hashBytes (hashed[j].hash, &(columns.entries[p].x), sizeof (PROBNODE));
+    }
+  }
+  num_columns = groupItems (hashed, info -> n, dedup -> column_group, sameColumnCallback, &columns);
+  wfree (hashed);
+  wfree (columns.start);
+  wfree (columns.entries);
+  kept_columns = numberGroups (dedup -> column_group, info -> n, num_columns, &(dedup -> column_weight));
+
+  /*  Build the merged rows; each count is multiplied by the sizes of its row and column groups  */
+  dedup -> ml_offset = 0.0;
+  cos = wmallocTag (num_rows * sizeof (COOCCUR*), WM_TAG_COOCCUR);
+  for (r = 0; r < num_rows; r++) {
+    row = info -> cos[kept_rows[r]];
+    count = 0;
+    for (pos = 1; pos <= row[0].column; pos++) {
+      j = row[pos].column;
+      if (kept_columns[dedup -> column_group[j]] == j) {
+        count++;
+      }
+    }
+
+    cos[r] = wmallocTag ((count + 1) * sizeof (COOCCUR), WM_TAG_COOCCUR);
+    cos[r][0].x = 0.0;
+    cos[r][0].column = count;
+    count = 0;
+    for (pos = 1; pos <= row[0].column; pos++) {
+      j = row[pos].column;
+      if (kept_columns[dedup -> column_group[j]] != j) {
+        continue;
+      }
+      count++;
+      cos[r][count].column = dedup -> column_group[j];
+      cos[r][count].x = row[pos].x + dedup -> row_weight[r] + dedup -> column_weight[dedup -> column_group[j]];
+      dedup -> ml_offset -= DOEXP (cos[r][count].x) * (dedup -> row_weight[r] + dedup -> column_weight[dedup -> column_group[j]]);
+    }
+    new_nonzeros += count;
+  }
+
+  for (i = 0; i < info -> m; i++) {
+    wfree (info -> cos[i]);
+  }
+  wfree (info -> cos);
+  info -> cos = cos;
+
+  dedup -> kept_m = num_rows;
+  dedup -> kept_row_ids = wmallocTag (num_rows * sizeof (unsigned int), WM_TAG_INDEX);
+  for (r = 0; r < num_rows; r++) {
+    dedup -> kept_row_ids[r] = info -> row_ids[kept_rows[r]];
+  }
+  dedup -> kept_column_ids = wmallocTag (num_columns * sizeof (unsigned int), WM_TAG_INDEX);
+  for (j = 0; j < num_columns; j++) {
+    dedup -> kept_column_ids[j] = info -> column_ids[kept_columns[j]];
+  }
+  wfree (kept_rows);
+  wfree (kept_columns);
+
+  info -> m = num_rows;
+  info -> n = num_columns;
+  info -> row_ids = dedup -> kept_row_ids;
+  info -> column_ids = dedup -> kept_column_ids;
+  info -> dedup = dedup;
+
+  if (info -> verbose) {
+    fprintf (stderr, "==\tRows after merging duplicates:                  %u of %u\n", num_rows, dedup -> m);
+    fprintf (stderr, "==\tColumns after merging duplicates:               %u of %u\n", num_columns, dedup -> n);
+    fprintf (stderr, "==\tNonzeros after merging duplicates:              %lu of %lu\n", new_nonzeros, old_nonzeros);
+  }
+
+  GET_TIME (end);
+  info -> readCO_time += ELAPSED_TIME (start, end);
+
+  return;
+}
+
+
+/*!
+**  Expand P(w1|z) and P(w2|z) of a model trained on the merged data to
+**  all rows and columns, and switch its sizes and identifiers back to
+**  those of the co-occurrence file.
+*/
+void expandProbs (INFO *info) {
+  DEDUP *dedup = info -> dedup;
+  PROBNODE *probw1_z = wmallocTag ((size_t) info -> num_clusters * dedup -> m * sizeof (PROBNODE), WM_TAG_MODEL);
+  PROBNODE *probw2_z = wmallocTag ((size_t) info -> num_clusters * dedup -> n * sizeof (PROBNODE), WM_TAG_MODEL);
+  unsigned int k;
+  unsigned int i;
+  unsigned int j;
+  unsigned int g;
+
+  for (k = 0; k < info -> num_clusters; k++) {
+    for (i = 0; i < dedup -> m; i++) {
+      g = dedup -> row_group[i];
+      probw1_z[(size_t) k * dedup -> m + i] = GET_PROBW1_Z (k, g) - dedup -> row_weight[g];
+    }
+    for (j = 0; j < dedup -> n; j++) {
+      g = dedup -> column_group[j];
+      probw2_z[(size_t) k * dedup -> n + j] = GET_PROBW2_Z (k, g) - dedup -> column_weight[g];
+    }
+  }
+
+  wfree (info -> probw1_z);
+  wfree (info -> probw2_z);
+  info -> probw1_z = probw1_z;
+  info -> probw2_z = probw2_z;
+  info -> m = dedup -> m;
+  info -> n = dedup -> n;
+  info -> row_ids = dedup -> row_ids;
+  info -> column_ids = dedup -> column_ids;
+
+  return;
+}
+
+
+void freeDedup (DEDUP *dedup) {
+  wfree (dedup -> row_ids);
+  wfree (dedup -> column_ids);
+  wfree (dedup -> kept_row_ids);
+  wfree (dedup -> kept_column_ids);
+  wfree (dedup -> row_group);
+  wfree (dedup -> column_group);
+  wfree (dedup -> row_weight);
+  wfree (dedup -> column_weight);
+  wfree (dedup);
+
+  return;
+}
+
@@ -0,0 +1,178 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+**  Accelerated EM using SQUAREM (Varadhan and Roland, 2008).  Two EM
+**  steps from theta0 give theta1 and theta2; with r = theta1 - theta0
+**  and v = theta2 - 2 theta1 + theta0, the parameters are extrapolated to
+**
+**    theta' = theta0 - 2 alpha r + alpha^2 v,  alpha = -|r| / |v|
+**
+**  and one more EM step is applied to theta'.  The parameters are
+**  extrapolated as log values, which keeps them positive; each
+**  distribution is renormalized afterwards.  If the log-likelihood
+**  decreases, the caller restores theta2 with undoAccelStep ().
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "wmalloc.h"
+#include "plsa-defn.h"
+#include "em-estep.h"
+#include "em-mstep.h"
+#include "em-accel.h"
+
+
+/*!  Normalize a distribution of (size) log values  */
+static void normalizeLogs (PROBNODE *values, unsigned int size) {
+  unsigned int i = 0;
+  PROBNODE sum = values[0];
+
+  for (i = 1; i < size; i++) {
+    logSumsInline (sum, values[i]);
+  }
+  for (i = 0; i < size; i++) {
+    values[i] = values[i] - sum;
+  }
+
+  return;
+}
+
+
+static void applyEMStep (INFO *info) {
+  applyEStep (info);
+  applyMStep (info);
+  normalizeProbs (info);
+  info -> iterations++;
+
+  return;
+}
+
+
+ACCEL *initAccel (INFO *info) {
+  ACCEL *accel = wmalloc (sizeof (ACCEL));
+
+  accel -> size = (size_t) info -> num_clusters * (1 + (size_t) info -> m + info -> n);
+  accel -> theta0 = wmallocTag (accel -> size * sizeof (PROBNODE), WM_TAG_ENGINE);
+  accel -> theta1 = wmallocTag (accel -> size * sizeof (PROBNODE), WM_TAG_ENGINE);
+  accel -> theta2 = wmallocTag (accel -> size * sizeof (PROBNODE), WM_TAG_ENGINE);
+  accel -> step_max = 1.0;
+  accel -> fallbacks = 0;
+
+  return (accel);
+}
+
+
+void freeAccel (ACCEL *accel) {
+  wfree (accel -> theta0);
+  wfree (accel -> theta1);
+  wfree (accel -> theta2);
+  wfree (accel);
+
+  return;
+}
+
+
+/*!  One SQUAREM cycle, which costs three EM steps  */
+void applyAccelStep (INFO *info, ACCEL *accel) {
+  PROBNODE *theta0 = accel -> theta0;
+  PROBNODE *theta1 = accel -> theta1;
+  PROBNODE *theta2 = accel -> theta2;
+  unsigned int num_clusters = info -> num_clusters;
+  size_t p = 0;
+  unsigned int k = 0;
+  PROBNODE r;
+  PROBNODE v;
+  PROBNODE r_norm = 0.0;
+  PROBNODE v_norm = 0.0;
+  PROBNODE alpha;
+
+  saveProbs (info, theta0);
+  applyEMStep (info);
+  saveProbs (info, theta1);
+  applyEMStep (info);
+  saveProbs (info, theta2);
+
+  for (p = 0; p < accel -> size; p++) {
+    /*  Probabilities of zero have no direction to extrapolate in  */
+    if ((!isfinite (theta0[p])) || (!isfinite (theta1[p])) || (!isfinite (theta2[p]))) {
+      continue;
+    }
+    r = theta1[p] - theta0[p];
+    v = theta2[p] - 2 * theta1[p] + theta0[p];
+    r_norm += r * r;
+    v_norm += v * v;
+  }
+
+  /*  Already at a fixed point  */
+  if ((r_norm == 0.0) || (v_norm == 0.0)) {
+    return;
+  }
+
+  /*  alpha = -1 gives theta2; longer steps are allowed as they succeed  */
+  alpha = -sqrt (r_norm / v_norm);
+  if (alpha > -1.0) {
+    alpha = -1.0;
+  }
+  if (alpha < -accel -> step_max) {
+    alpha = -accel -> step_max;
+  }
+  if (alpha == -accel -> step_max) {
+    accel -> step_max *= ACCEL_STEP_FACTOR;
+  }
+
+  /*  theta0 is overwritten by the extrapolated parameters  */
+  for (p = 0; p < accel -> size; p++) {
+    if ((!isfinite (theta0[p])) || (!isfinite (theta1[p])) || (!isfinite (theta2[p]))) {
+      theta0[p] = theta2[p];
+      continue;
+    }
+    r = theta1[p] - theta0[p];
+    v = theta2[p] - 2 * theta1[p] + theta0[p];
+    theta0[p] = theta0[p] - 2 * alpha * r + alpha * alpha * v;
+  }
+
+  normalizeLogs (theta0, num_clusters);
+  for (k = 0; k < num_clusters; k++) {
+    normalizeLogs (theta0 + num_clusters + (size_t) k * info -> m, info -> m);
+    normalizeLogs (theta0 + num_clusters + (size_t) num_clusters * info -> m + (size_t) k * info -> n, info -> n);
+  }
+  restoreProbs (info, theta0);
+
+  /*  Stabilizing EM step  */
+  applyEMStep (info);
+
+  return;
+}
+
+
+/*!  Fall back to the plain EM step (theta2) after the log-likelihood decreased  */
+void undoAccelStep (INFO *info, ACCEL *accel) {
+  restoreProbs (info, accel -> theta2);
+  accel -> step_max = 1.0;
+  accel -> fallbacks++;
+
+  return;
+}
+
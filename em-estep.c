@@ -20,41 +20,194 @@
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#include <float.h>
 #include <math.h>  /*  log10 function  */
 #include <stdbool.h>
 #include <time.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include "wmalloc.h"
 #include "plsa-defn.h"
+#include "input.h"
+#include "perf.h"
 #include "em-estep.h"
 
-void initEM (INFO *info) {
-  unsigned int num_clusters = info -> num_clusters;
-  register unsigned int i;  /*  Index into w1  */
-  register unsigned int j;  /*  Index into w2  */
-  register unsigned int k;  /*  Index into clusters  */
-  register PROBNODE sum;
-  time_t start;
-  time_t end;
+/*!
+**  Overwrite the random initial values with those of a previously
+**  trained model.  Rows and columns are matched by their identifiers;
+**  those not found in the model keep their random values.  Each
+**  cluster is then renormalized.
+*/
+static void warmStart (INFO *info) {
+  MODEL *model = NULL;
+  unsigned int *row_map = NULL;
+  unsigned int *column_map = NULL;
+  unsigned int i;  /*  Index into w1  */
+  unsigned int j;  /*  Index into w2  */
+  unsigned int k;  /*  Index into clusters  */
+  unsigned int found_rows = 0;
+  unsigned int found_columns = 0;
+  PROBNODE sum;
 
-  time (&start);
-  PROGRESS_MSG ("Begin initialization...");
+  model = readModel (info, info -> init_model_fn);
+  if (model -> num_clusters != info -> num_clusters) {
+    fprintf (stderr, "Model %s has %u clusters, but %u were requested.\n", info -> init_model_fn, model -> num_clusters, info -> num_clusters);
+    exit (EXIT_FAILURE);
+  }
 
-  /*  Assign probabilities to probz  */
-  sum = 0.0;
-  for (k = 0; k < num_clusters; k++) {
-    GET_PROBZ (k) = RANDOM_FLOAT;
-    sum += GET_PROBZ (k);
+  row_map = mapIdentifiers (info -> row_ids, info -> m, model -> row_ids, model -> m);
+  column_map = mapIdentifiers (info -> column_ids, info -> n, model -> column_ids, model -> n);
+
+  for (k = 0; k < info -> num_clusters; k++) {
+    GET_PROBZ (k) = model -> probz[k];
   }
-  for (k = 0; k < num_clusters; k++) {
-    GET_PROBZ (k) = DOLOG (GET_PROBZ (k) / sum);
+
+  for (i = 0; i < info -> m; i++) {
+    if (row_map[i] == UINT_MAX) {
+      continue;
+    }
+    found_rows++;
+    for (k = 0; k < info -> num_clusters; k++) {
+      GET_PROBW1_Z (k, i) = model -> probw1_z[(size_t) k * model -> m + row_map[i]];
+    }
   }
 
-  /*  Assign probabilities to probw1_z  */
-  for (i = 0; i < (info -> num_clusters * info -> m); i++) {
-    info -> probw1_z[i] = RANDOM_FLOAT;
+  for (j = 0; j < info -> n; j++) {
+    if (column_map[j] == UINT_MAX) {
+      continue;
+    }
+    found_columns++;
+    for (k = 0; k < info -> num_clusters; k++) {
+      GET_PROBW2_Z (k, j) = model -> probw2_z[(size_t) k * model -> n + column_map[j]];
+    }
   }
-  for (k = 0; k < num_clusters; k++) {
+
+  /*  Rows and columns that were added or removed unbalance each cluster  */
+  for (k = 0; k < info -> num_clusters; k++) {
+    sum = GET_PROBW1_Z (k, 0);
+    for (i = 1; i < info -> m; i++) {
+      logSumsInline (sum, GET_PROBW1_Z (k, i));
+    }
+    for (i = 0; i < info -> m; i++) {
+      GET_PROBW1_Z (k, i) = GET_PROBW1_Z (k, i) - sum;
+    }
+
+    sum = GET_PROBW2_Z (k, 0);
+    for (j = 1; j < info -> n; j++) {
+      logSumsInline (sum, GET_PROBW2_Z (k, j));
+    }
+    for (j = 0; j < info -> n; j++) {
+      GET_PROBW2_Z (k, j) = GET_PROBW2_Z (k, j) - sum;
+    }
+  }
+
+  if (info -> verbose) {
+    fprintf (stderr, "==	Warm start rows found in model:                 %u of %u\n", found_rows, info -> m);
+    fprintf (stderr, "==	Warm start columns found in model:              %u of %u\n", found_columns, info -> n);
+  }
+
+  wfree (row_map);
+  wfree (column_map);
+  freeModel (model);
+
+  return;
+}
+
+
+/*!  Clusters initialized by one thread  */
+typedef struct init_work {
+  INFO *info;
+  unsigned int first_cluster;
+  unsigned int last_cluster;
+} INIT_WORK;
+
+/*!  Streams of the generator, one for each array being initialized  */
+enum { INIT_STREAM_PROBZ, INIT_STREAM_PROBW1_Z, INIT_STREAM_PROBW2_Z, INIT_STREAM_ROWS };
+
+
+/*!
+**  Philox4x32-10 counter-based generator (Salmon et al., 2011):  the four
+**  words of out depend only on the counter and the key, so any value can
+**  be generated on its own, by any thread, in any order.
+*/
+static void philox (const uint32_t *counter, const uint32_t *key, uint32_t *out) {
+  uint32_t c0 = counter[0];
+  uint32_t c1 = counter[1];
+  uint32_t c2 = counter[2];
+  uint32_t c3 = counter[3];
+  uint32_t k0 = key[0];
+  uint32_t k1 = key[1];
+  uint64_t prod0;
+  uint64_t prod1;
+  unsigned int r = 0;
+
+  for (r = 0; r < PHILOX_ROUNDS; r++) {
+    prod0 = (uint64_t) PHILOX_M0 * c0;
+    prod1 = (uint64_t) PHILOX_M1 * c2;
+    c0 = (uint32_t) (prod1 >> 32) ^ c1 ^ k0;
+    c2 = (uint32_t) (prod0 >> 32) ^ c3 ^ k1;
+    c1 = (uint32_t) prod1;
+    c3 = (uint32_t) prod0;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+
+  return;
+}
+
+
+/*!
+**  Fill dest[0 .. last - first - 1] with the numbers in [0, 1) of the
+**  positions first .. last - 1, which depend only on the seed, the stream
+**  and the position.  Each call of the generator gives the values of two
+**  consecutive positions.
+*/
+static void randomFill (PROBNODE *dest, size_t first, size_t last, unsigned int seed, unsigned int stream) {
+  uint32_t counter[4];
+  uint32_t key[2];
+  uint32_t out[4];
+  size_t p = first;
+  unsigned int w = 0;  /*  Word of out to start from  */
+
+  key[0] = seed;
+  key[1] = 0;
+  counter[2] = stream;
+  counter[3] = 0;
+  while (p < last) {
+    counter[0] = (uint32_t) (p >> 1);
+    counter[1] = (uint32_t) ((uint64_t) p >> 33);
+    philox (counter, key, out);
+    /*  53 random bits from two words for each value  */
+    for (w = 2 * (p & 1); (w < 4) && (p < last); w += 2, p++) {
+      dest[p - first] = ((PROBNODE) (out[w] >> 5) * 67108864.0 + (PROBNODE) (out[w + 1] >> 6)) / 9007199254740992.0;
+    }
+  }
+
+  return;
+}
+
+
+/*!
+**  Assign random values to P(w1|z) and P(w2|z) of a range of clusters and
+**  normalize each cluster.  A cluster is always summed by one thread in
+**  the same order, so the result does not depend on the number of threads.
+*/
+static void *initWorker (void *arg) {
+  INIT_WORK *work = (INIT_WORK*) arg;
+  INFO *info = work -> info;
+  unsigned int i;  /*  Index into w1  */
+  unsigned int j;  /*  Index into w2  */
+  unsigned int k;  /*  Index into clusters  */
+  PROBNODE sum;
+
+  /*  Assign probabilities to probw1_z  */
+  randomFill (&(GET_PROBW1_Z (work -> first_cluster, 0)), (size_t) work -> first_cluster * info -> m, (size_t) work -> last_cluster * info -> m, info -> seed, INIT_STREAM_PROBW1_Z);
+  for (k = work -> first_cluster; k < work -> last_cluster; k++) {
     sum = 0.0;
     for (i = 0; i < info -> m; i++) {
       sum += GET_PROBW1_Z (k, i);
@@ -65,11 +218,9 @@ void initEM (INFO *info) {
   }
 
   /*  Assign probabilities to probw2_z  */
-  for (i = 0; i < (info -> num_clusters * info -> n); i++) {
-    info -> probw2_z[i] = RANDOM_FLOAT;
-  }
-  for (k = 0; k < num_clusters; k++) {
-    sum= 0.0;
+  randomFill (&(GET_PROBW2_Z (work -> first_cluster, 0)), (size_t) work -> first_cluster * info -> n, (size_t) work -> last_cluster * info -> n, info -> seed, INIT_STREAM_PROBW2_Z);
+  for (k = work -> first_cluster; k < work -> last_cluster; k++) {
+    sum = 0.0;
     for (j = 0; j < info -> n; j++) {
       sum += GET_PROBW2_Z (k, j);
     }
@@ -78,9 +229,259 @@ void initEM (INFO *info) {
     }
   }
 
+  return (NULL);
+}
+
+
+/*!
+**  Choose one row of the co-occurrence data for each cluster.  With
+**  --init sample, the rows are drawn uniformly without replacement;  with
+**  --init kmeans++, each row after the first is drawn with probability
+**  proportional to the squared Euclidean distance between its distribution
+**  over columns and that of the nearest row chosen so far.  Empty rows are
+**  never chosen.  Returns the number of rows chosen, which is less than
+**  the number of clusters only if there are fewer nonempty rows.
+*/
+static unsigned int chooseRows (INFO *info, unsigned int *chosen) {
+  unsigned int num_clusters = info -> num_clusters;
+  unsigned int *rows = wmalloc (info -> m * sizeof (unsigned int));
+  unsigned int num_rows = 0;  /*  Number of nonempty rows  */
+  unsigned int num_chosen = 0;
+  unsigned int cos_count;
+  unsigned int i;  /*  Index into w1  */
+  unsigned int pos_j;
+  unsigned int c;  /*  Index into rows  */
+  unsigned int last = 0;  /*  Row chosen last, as an index into rows  */
+  unsigned int temp;
+  PROBNODE *mass = NULL;  /*  Sum of the counts of each row  */
+  PROBNODE *norm = NULL;  /*  Squared norm of the distribution of each row  */
+  PROBNODE *dist = NULL;  /*  Squared distance to the nearest chosen row  */
+  PROBNODE *center = NULL;  /*  Distribution of the last row chosen, over the columns  */
+  PROBNODE total;
+  PROBNODE dot;
+  PROBNODE value;
+
+  for (i = 0; i < info -> m; i++) {
+    if (GET_COS_POSITION (i, 0) != 0) {
+      rows[num_rows++] = i;
+    }
+  }
+  if (num_rows == 0) {
+    wfree (rows);
+    return (0);
+  }
+
+  if (info -> init_mode == INIT_SAMPLE) {
+    /*  Partial Fisher-Yates shuffle of the nonempty rows  */
+    for (num_chosen = 0; (num_chosen < num_clusters) && (num_chosen < num_rows); num_chosen++) {
+      randomFill (&value, num_chosen, num_chosen + 1, info -> seed, INIT_STREAM_ROWS);
+      c = num_chosen + (unsigned int) (value * (num_rows - num_chosen));
+      temp = rows[num_chosen];
+      rows[num_chosen] = rows[c];
+      rows[c] = temp;
+      chosen[num_chosen] = rows[num_chosen];
+    }
+    wfree (rows);
+    return (num_chosen);
+  }
+
+  mass = wmalloc (num_rows * sizeof (PROBNODE));
+  norm = wmalloc (num_rows * sizeof (PROBNODE));
+  dist = wmalloc (num_rows * sizeof (PROBNODE));
+  center = wmalloc (info -> n * sizeof (PROBNODE));
+  for (c = 0; c < num_rows; c++) {
+    i = rows[c];
+    cos_count = GET_COS_POSITION (i, 0);
+    mass[c] = 0.0;
+    for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+      mass[c] += DOEXP (GET_COS (i, pos_j));
+    }
+    norm[c] = 0.0;
+    for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+      value = DOEXP (GET_COS (i, pos_j)) / mass[c];
+      norm[c] += value * value;
+    }
+    dist[c] = DBL_MAX;
+  }
+  for (i = 0; i < info -> n; i++) {
+    center[i] = 0.0;
+  }
+
+  /*  The first row is drawn uniformly  */
+  randomFill (&value, 0, 1, info -> seed, INIT_STREAM_ROWS);
+  last = (unsigned int) (value * num_rows);
+  while (true) {
+    chosen[num_chosen++] = rows[last];
+    if (num_chosen == num_clusters) {
+      break;
+    }
+
+    /*  Distance of each row to the one just chosen, whose distribution is spread out in center  */
+    i = rows[last];
+    cos_count = GET_COS_POSITION (i, 0);
+    for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+      center[GET_COS_POSITION (i, pos_j)] = DOEXP (GET_COS (i, pos_j)) / mass[last];
+    }
+    for (c = 0; c < num_rows; c++) {
+      i = rows[c];
+      cos_count = GET_COS_POSITION (i, 0);
+      dot = 0.0;
+      for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+        dot += DOEXP (GET_COS (i, pos_j)) * center[GET_COS_POSITION (i, pos_j)];
+      }
+      value = norm[c] + norm[last] - 2.0 * dot / mass[c];
+      if (value < 0.0) {
+        value = 0.0;
+      }
+      if (value < dist[c]) {
+        dist[c] = value;
+      }
+    }
+    i = rows[last];
+    cos_count = GET_COS_POSITION (i, 0);
+    for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+      center[GET_COS_POSITION (i, pos_j)] = 0.0;
+    }
+
+    /*  Draw the next row in proportion to its squared distance  */
+    total = 0.0;
+    for (c = 0; c < num_rows; c++) {
+      total += dist[c];
+    }
+    if (total <= 0.0) {
+      /*  Every row is a copy of one already chosen  */
+      break;
+    }
+    randomFill (&value, num_chosen, num_chosen + 1, info -> seed, INIT_STREAM_ROWS);
+    value *= total;
+    for (last = 0; last < num_rows - 1; last++) {
+      if (dist[last] > value) {
+        break;
+      }
+      value -= dist[last];
+    }
+    /*  Rounding can run off the end onto rows at distance 0  */
+    while (dist[last] == 0.0) {
+      last--;
+    }
+  }
+
+  wfree (rows);
+  wfree (mass);
+  wfree (norm);
+  wfree (dist);
+  wfree (center);
+
+  return (num_chosen);
+}
+
+
+/*!
+**  Mix the random P(w2|z) of each cluster with the distribution over
+**  columns of a row chosen by chooseRows (), so that the clusters start
+**  out near different parts of the data.  Clusters left without a row
+**  keep their random values.
+*/
+static void seedFromRows (INFO *info) {
+  unsigned int *chosen = wmalloc (info -> num_clusters * sizeof (unsigned int));
+  unsigned int num_chosen = chooseRows (info, chosen);
+  unsigned int cos_count;
+  unsigned int i;  /*  Index into w1  */
+  unsigned int j;  /*  Index into w2  */
+  unsigned int k;  /*  Index into clusters  */
+  unsigned int pos_j;
+  PROBNODE total;
+
+  for (k = 0; k < num_chosen; k++) {
+    for (j = 0; j < info -> n; j++) {
+      GET_PROBW2_Z (k, j) = (1.0 - INIT_ROW_WEIGHT) * DOEXP (GET_PROBW2_Z (k, j));
+    }
+    i = chosen[k];
+    cos_count = GET_COS_POSITION (i, 0);
+    total = 0.0;
+    for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+      total += DOEXP (GET_COS (i, pos_j));
+    }
+    for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+      GET_PROBW2_Z (k, GET_COS_POSITION (i, pos_j)) += INIT_ROW_WEIGHT * DOEXP (GET_COS (i, pos_j)) / total;
+    }
+    for (j = 0; j < info -> n; j++) {
+      GET_PROBW2_Z (k, j) = DOLOG (GET_PROBW2_Z (k, j));
+    }
+  }
+
+  if (info -> verbose) {
+    fprintf (stderr, "==	Clusters initialized from rows:                 %u of %u\n", num_chosen, info -> num_clusters);
+  }
+
+  wfree (chosen);
+
+  return;
+}
+
+
+void initEM (INFO *info) {
+  unsigned int num_clusters = info -> num_clusters;
+  unsigned int num_threads = info -> mstep_threads;
+  register unsigned int k;  /*  Index into clusters  */
+  unsigned int t = 0;
+  register PROBNODE sum;
+  INIT_WORK *work = NULL;
+  pthread_t *threads = NULL;
+  struct timespec start;
+  struct timespec end;
+
+  GET_TIME (start);
+  PROGRESS_MSG ("Begin initialization...");
+
+  /*  Assign probabilities to probz  */
+  randomFill (info -> probz, 0, num_clusters, info -> seed, INIT_STREAM_PROBZ);
+  sum = 0.0;
+  for (k = 0; k < num_clusters; k++) {
+    sum += GET_PROBZ (k);
+  }
+  for (k = 0; k < num_clusters; k++) {
+    GET_PROBZ (k) = DOLOG (GET_PROBZ (k) / sum);
+  }
+
+  /*  P(w1|z) and P(w2|z) are shared by the M-step threads of the model,
+  **  each taking a range of clusters  */
+  if (num_threads > num_clusters) {
+    num_threads = num_clusters;
+  }
+  work = wmalloc (num_threads * sizeof (INIT_WORK));
+  for (t = 0; t < num_threads; t++) {
+    work[t].info = info;
+    work[t].first_cluster = (unsigned int) ((unsigned long) num_clusters * t / num_threads);
+    work[t].last_cluster = (unsigned int) ((unsigned long) num_clusters * (t + 1) / num_threads);
+  }
+  if (num_threads == 1) {
+    initWorker (&(work[0]));
+  }
+  else {
+    threads = wmalloc (num_threads * sizeof (pthread_t));
+    for (t = 0; t < num_threads; t++) {
+      pthread_create (&(threads[t]), NULL, initWorker, &(work[t]));
+    }
+    for (t = 0; t < num_threads; t++) {
+      pthread_join (threads[t], NULL);
+    }
+    wfree (threads);
+  }
+  wfree (work);
+
+  if (info -> init_mode != INIT_RANDOM) {
+    seedFromRows (info);
+  }
+
+  /*  Unseen rows and columns keep the random values assigned above  */
+  if (info -> init_model_fn != NULL) {
+    warmStart (info);
+  }
+
   PROGRESS_MSG ("Initialization complete...");
-  time (&end);
-  info -> initEM_time += difftime (end, start);
+  GET_TIME (end);
+  info -> initEM_time += ELAPSED_TIME (start, end);
 
   return;
 }
@@ -91,17 +492,20 @@ void applyEStep (INFO *info) {
   unsigned int i = 0;  /*  Index into w1  */
   unsigned int j = 0;  /*  Index into w2  */
   unsigned int k = 0;  /*  Index into clusters  */
+  PROBNODE beta = info -> beta;
   PROBNODE sum = 0.0;
-  time_t start;
-  time_t end;
+  struct timespec start;
+  struct timespec end;
 
-  time (&start);
+  GET_TIME (start);
+  PERF_START (perf_fds);
   for (i = 0; i < info -> m; i++) {
     for (j = 0; j < info -> n; j++) {
-      GET_PROBZ_W1W2 (0, i, j) = GET_PROBW1_Z (0, i) + GET_PROBW2_Z (0, j) + GET_PROBZ (0);
+      /*  Tempered EM raises P(z) P(w1|z) P(w2|z) to the power beta  */
+      GET_PROBZ_W1W2 (0, i, j) = beta * (GET_PROBW1_Z (0, i) + GET_PROBW2_Z (0, j) + GET_PROBZ (0));
       sum = GET_PROBZ_W1W2 (0, i, j);
       for (k = 1; k < num_clusters; k++) {
-        GET_PROBZ_W1W2 (k, i, j) = GET_PROBW1_Z (k, i) + GET_PROBW2_Z (k, j) + GET_PROBZ (k);
+        GET_PROBZ_W1W2 (k, i, j) = beta * (GET_PROBW1_Z (k, i) + GET_PROBW2_Z (k, j) + GET_PROBZ (k));
         logSumsInline (sum, GET_PROBZ_W1W2 (k, i, j));
       }
 
@@ -112,8 +516,9 @@ void applyEStep (INFO *info) {
     }
   }
 
-  time (&end);
-  info -> applyEStep_time += difftime (end, start);
+  PERF_STOP (perf_fds, info -> applyEStep_perf);
+  GET_TIME (end);
+  info -> applyEStep_time += ELAPSED_TIME (start, end);
 
   return;
 }
@@ -128,11 +533,12 @@ PROBNODE calculateML (INFO *info) {
   register unsigned int cos_count;  /*  Number of cooccurrences in each row  */
   register PROBNODE total = 0.0;
   PROBNODE temp;
-  unsigned int count = 0;
-  time_t start;
-  time_t end;
+  unsigned long count = 0;
+  struct timespec start;
+  struct timespec end;
 
-  time (&start);
+  GET_TIME (start);
+  PERF_START (perf_fds);
 
   for (i = 0; i < info -> m; i++) {
     cos_count = GET_COS_POSITION (i, 0);
@@ -153,8 +559,32 @@ PROBNODE calculateML (INFO *info) {
     }
   }
 
-  time (&end);
-  info -> calculateML_time += difftime (end, start);
+  /*  Merged rows and columns stand for several each; see dedupCO ()  */
+  if (info -> dedup != NULL) {
+    total += info -> dedup -> ml_offset;
+  }
+
+  /*  The held-out nonzeros are scored in the same pass  */
+  if (info -> heldout != NULL) {
+    info -> heldout_ML = 0.0;
+    for (i = 0; i < info -> m; i++) {
+      cos_count = info -> heldout[i][0].column;
+      for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+        j = info -> heldout[i][pos_j].column;
+
+        temp = (GET_PROBZ (0) + GET_PROBW1_Z (0, i) + GET_PROBW2_Z (0, j));
+        for (k = 1; k < num_clusters; k++) {
+          logSumsInline (temp, GET_PROBZ (k) + GET_PROBW1_Z (k, i) + GET_PROBW2_Z (k, j));
+        }
+
+        info -> heldout_ML += (temp * DOEXP (info -> heldout[i][pos_j].x));
+      }
+    }
+  }
+
+  PERF_STOP (perf_fds, info -> calculateML_perf);
+  GET_TIME (end);
+  info -> calculateML_time += ELAPSED_TIME (start, end);
 
   return (total);
 }
@@ -23,11 +23,213 @@
 #include <math.h>  /*  log10 function  */
 #include <stdbool.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "wmalloc.h"
 #include "plsa-defn.h"
+#include "perf.h"
 #include "em-mstep.h"
 
+/*!  Rows and columns handled by one thread of the parallel M-step  */
+typedef struct mstep_work {
+  INFO *info;
+  unsigned int first_row;
+  unsigned int last_row;
+  unsigned int first_column;
+  unsigned int last_column;
+} MSTEP_WORK;
+
+
+/*!
+**  Accumulate P(w1|z) of a range of rows and P(w2|z) of a range of
+**  columns, the latter through the column index.  No two threads write
+**  the same value, and each one is summed in the same order as in the
+**  serial M-step.
+*/
+static void *mStepWorker (void *arg) {
+  MSTEP_WORK *work = (MSTEP_WORK*) arg;
+  INFO *info = work -> info;
+  COLINDEX *colindex = info -> colindex;
+  unsigned int i;  /*  Index into w1  */
+  unsigned int j;  /*  Index into w2  */
+  unsigned int k;  /*  Index into clusters  */
+  unsigned int pos_j;  /*  Actual position in the cooccurrence array  */
+  unsigned int cos_count;  /*  Number of cooccurrences in each row  */
+  size_t p;  /*  Position in the column index  */
+  PROBNODE sum;
+
+  /*  probw1_z  */
+  for (i = work -> first_row; i < work -> last_row; i++) {
+    cos_count = GET_COS_POSITION (i, 0);
+    if (cos_count == 0) {
+      continue;
+    }
+    for (k = 0; k < info -> block_size; k++) {
+      j = GET_COS_POSITION (i, 1);
+      sum = GET_COS (i, 1) + GET_PROBZ_W1W2 (k, i, j);
+      for (pos_j = 2; pos_j <= cos_count; pos_j++) {
+        j = GET_COS_POSITION (i, pos_j);
+        logSumsInline (sum, GET_COS (i, pos_j) + GET_PROBZ_W1W2 (k, i, j));
+      }
+      GET_PROBW1_Z (k, i) = sum;
+    }
+  }
+
+  /*  probw2_z  */
+  for (j = work -> first_column; j < work -> last_column; j++) {
+    if (colindex -> start[j] == colindex -> start[j + 1]) {
+      continue;
+    }
+    for (k = 0; k < info -> block_size; k++) {
+      p = colindex -> start[j];
+      i = colindex -> row[p];
+      sum = GET_COS (i, colindex -> pos[p]) + GET_PROBZ_W1W2 (k, i, j);
+      for (p++; p < colindex -> start[j + 1]; p++) {
+        i = colindex -> row[p];
+        logSumsInline (sum, GET_COS (i, colindex -> pos[p]) + GET_PROBZ_W1W2 (k, i, j));
+      }
+      GET_PROBW2_Z (k, j) = sum;
+    }
+  }
+
+  return (NULL);
+}
+
+
+/*!
+**  Split the rows and the columns among (info -> mstep_threads) threads
+**  into ranges with about the same number of nonzeros.
+*/
+static MSTEP_WORK *splitMStep (INFO *info) {
+  unsigned int num_threads = info -> mstep_threads;
+  size_t *start = info -> colindex -> start;
+  unsigned long nonzeros = start[info -> n];
+  unsigned long target = 0;
+  unsigned long count = 0;
+  unsigned int i = 0;
+  unsigned int j = 0;
+  unsigned int t = 0;
+  MSTEP_WORK *work = wmalloc (num_threads * sizeof (MSTEP_WORK));
+
+  for (t = 0; t < num_threads; t++) {
+    target = nonzeros * (t + 1) / num_threads;
+    work[t].info = info;
+
+    work[t].first_row = i;
+    while ((i < info -> m) && (count < target)) {
+      count += GET_COS_POSITION (i, 0);
+      i++;
+    }
+    work[t].last_row = (t == num_threads - 1) ? info -> m : i;
+
+    work[t].first_column = j;
+    while ((j < info -> n) && (start[j] < target)) {
+      j++;
+    }
+    work[t].last_column = (t == num_threads - 1) ? info -> n : j;
+  }
+
+  return (work);
+}
+
+
+/*!  Write zeros over the rows and columns of one thread of the M-step  */
+static void *touchWorker (void *arg) {
+  MSTEP_WORK *work = (MSTEP_WORK*) arg;
+  INFO *info = work -> info;
+  unsigned int rows = work -> last_row - work -> first_row;
+  unsigned int columns = work -> last_column - work -> first_column;
+  unsigned int i = work -> first_row;
+  unsigned int j = work -> first_column;
+  unsigned int k;
+
+  for (k = 0; k < info -> num_clusters; k++) {
+    memset (&(GET_PROBW1_Z (k, i)), 0, rows * sizeof (PROBNODE));
+    memset (&(GET_PROBW2_Z (k, j)), 0, columns * sizeof (PROBNODE));
+    if (info -> probz_w1w2 != NULL) {
+      memset (&(GET_PROBZ_W1W2 (k, i, 0)), 0, (size_t) rows * info -> n * sizeof (PROBNODE));
+    }
+  }
+
+  return (NULL);
+}
+
+
+/*!
+**  Have each thread of the parallel M-step be the first to write its
+**  part of P(w1|z), P(w2|z) and P(z|w1,w2), so that the kernel places
+**  those pages on its NUMA node (--numa local).  Called just after they
+**  are allocated.
+*/
+void touchMStepPartitions (INFO *info) {
+  unsigned int num_threads = info -> mstep_threads;
+  unsigned int t = 0;
+  MSTEP_WORK *work = splitMStep (info);
+  pthread_t *threads = wmalloc (num_threads * sizeof (pthread_t));
+
+  for (t = 0; t < num_threads; t++) {
+    pthread_create (&(threads[t]), NULL, touchWorker, &(work[t]));
+  }
+  for (t = 0; t < num_threads; t++) {
+    pthread_join (threads[t], NULL);
+  }
+
+  wfree (work);
+  wfree (threads);
+
+  return;
+}
+
+
+/*!
+**  M-step with (info -> mstep_threads) threads, each over the rows and
+**  columns given by splitMStep ();  P(z) is then the sum of P(w1|z) over
+**  the rows.
+*/
+static void applyParallelMStep (INFO *info) {
+  unsigned int num_threads = info -> mstep_threads;
+  unsigned int i = 0;
+  unsigned int k = 0;
+  unsigned int t = 0;
+  bool flag_z = false;
+  MSTEP_WORK *work = splitMStep (info);
+  pthread_t *threads = wmalloc (num_threads * sizeof (pthread_t));
+
+  for (t = 0; t < num_threads; t++) {
+    pthread_create (&(threads[t]), NULL, mStepWorker, &(work[t]));
+  }
+  for (t = 0; t < num_threads; t++) {
+    pthread_join (threads[t], NULL);
+  }
+
+  /*  probz  */
+  for (k = 0; k < info -> block_size; k++) {
+    flag_z = false;
+    for (i = 0; i < info -> m; i++) {
+      if (GET_COS_POSITION (i, 0) == 0) {
+        continue;
+      }
+      if (flag_z) {
+        logSumsInline (GET_PROBZ (k), GET_PROBW1_Z (k, i));
+      }
+      else {
+        GET_PROBZ (k) = GET_PROBW1_Z (k, i);
+        flag_z = true;
+      }
+    }
+  }
+
+  wfree (work);
+  wfree (threads);
+
+  return;
+}
+
+
+/*!
+**  Accumulate P(z), P(w1|z) and P(w2|z) from P(z|w1,w2).  With a column
+**  index, the work is shared by (info -> mstep_threads) threads.
+*/
 void applyMStep (INFO *info) {
   register unsigned int i;  /*  Index into w1  */
   register unsigned int j;  /*  Index into w2  */
@@ -39,10 +241,19 @@ void applyMStep (INFO *info) {
   bool **flag_w1_z = NULL;
   bool **flag_w2_z = NULL;
 
-  time_t start;
-  time_t end;
+  struct timespec start;
+  struct timespec end;
 
-  time (&start);
+  GET_TIME (start);
+  PERF_START (perf_fds);
+
+  if (info -> colindex != NULL) {
+    applyParallelMStep (info);
+    PERF_STOP (perf_fds, info -> applyMStep_perf);
+    GET_TIME (end);
+    info -> applyMStep_time += ELAPSED_TIME (start, end);
+    return;
+  }
 
   /*******************************************************/
   /*  Initialize flags that indicate whether the cell is so far untouched   */
@@ -119,24 +330,211 @@ void applyMStep (INFO *info) {
   wfree (flag_w1_z);
   wfree (flag_w2_z);
 
-  time (&end);
-  info -> applyMStep_time += difftime (end, start);
+  PERF_STOP (perf_fds, info -> applyMStep_perf);
+  GET_TIME (end);
+  info -> applyMStep_time += ELAPSED_TIME (start, end);
+
+  return;
+}
+
+
+/*!  Record the largest change in a probability since the last normalization  */
+static inline void trackChange (PROBNODE *prev, PROBNODE curr, PROBNODE *change) {
+  PROBNODE diff = fabs (DOEXP (curr) - DOEXP (*prev));
+
+  if (diff > *change) {
+    *change = diff;
+  }
+  *prev = curr;
+
+  return;
+}
+
+
+/*!
+**  With --ptol, keep a copy of the parameters in (info -> prev_probs) so
+**  that normalizeProbs () can measure how much they change.  Called by
+**  each engine before its first iteration, and undone by freePrevProbs ().
+*/
+void initPrevProbs (INFO *info) {
+  if (info -> ptol > 0) {
+    info -> prev_probs = wmallocTag ((size_t) info -> num_clusters * (1 + (size_t) info -> m + info -> n) * sizeof (PROBNODE), WM_TAG_ENGINE);
+    saveProbs (info, info -> prev_probs);
+  }
 
   return;
 }
 
 
-/*!  Normalize probabilities  */
+void freePrevProbs (INFO *info) {
+  if (info -> prev_probs != NULL) {
+    wfree (info -> prev_probs);
+    info -> prev_probs = NULL;
+  }
+
+  return;
+}
+
+
+/*!
+**  Remove the clusters whose P(z) has been below (info -> prune_threshold)
+**  for PRUNE_PATIENCE calls in a row, moving the remaining ones down so
+**  that later iterations only work on those.  At least one cluster is
+**  always kept.  P(z) is renormalized afterwards.
+*/
+static void pruneClusters (INFO *info) {
+  unsigned int old_clusters = info -> num_clusters;
+  unsigned int new_clusters = 0;
+  size_t m = info -> m;
+  size_t n = info -> n;
+  unsigned int k;
+  unsigned int t = 0;  /*  New index of cluster k  */
+  bool *keep = NULL;
+  PROBNODE *prev = info -> prev_probs;
+  PROBNODE threshold = DOLOG (info -> prune_threshold);
+  PROBNODE sum;
+
+  for (k = 0; k < old_clusters; k++) {
+    if (GET_PROBZ (k) < threshold) {
+      info -> dead_iters[k]++;
+    }
+    else {
+      info -> dead_iters[k] = 0;
+    }
+    if (info -> dead_iters[k] < PRUNE_PATIENCE) {
+      new_clusters++;
+    }
+  }
+  if ((new_clusters == old_clusters) || (new_clusters == 0)) {
+    return;
+  }
+
+  keep = wmalloc (old_clusters * sizeof (bool));
+  for (k = 0; k < old_clusters; k++) {
+    keep[k] = (info -> dead_iters[k] < PRUNE_PATIENCE);
+    if (!keep[k]) {
+      info -> pruned[info -> num_pruned].cluster = info -> cluster_ids[k];
+      info -> pruned[info -> num_pruned].iteration = info -> iter;
+      info -> pruned[info -> num_pruned].probz = GET_PROBZ (k);
+      info -> num_pruned++;
+      if (info -> verbose) {
+        fprintf (stderr, "[%3u]  Cluster %u pruned (P(z) = %g)\n", info -> iter, info -> cluster_ids[k], DOEXP (GET_PROBZ (k)));
+      }
+      if (info -> probz_w1w2 != NULL) {
+        wfree (info -> probz_w1w2[k]);
+      }
+    }
+  }
+
+  /*  Clusters only move down, so copying them in order is safe  */
+  for (k = 0, t = 0; k < old_clusters; k++) {
+    if (!keep[k]) {
+      continue;
+    }
+    GET_PROBZ (t) = GET_PROBZ (k);
+    memmove (&(GET_PROBW1_Z (t, 0)), &(GET_PROBW1_Z (k, 0)), m * sizeof (PROBNODE));
+    memmove (&(GET_PROBW2_Z (t, 0)), &(GET_PROBW2_Z (k, 0)), n * sizeof (PROBNODE));
+    if (info -> probz_w1w2 != NULL) {
+      info -> probz_w1w2[t] = info -> probz_w1w2[k];
+    }
+    info -> cluster_ids[t] = info -> cluster_ids[k];
+    info -> dead_iters[t] = info -> dead_iters[k];
+    t++;
+  }
+
+  /*  The previous probabilities hold P(z), P(w1|z) and P(w2|z) one after
+  **  the other, so each part moves separately  */
+  if (prev != NULL) {
+    for (k = 0, t = 0; k < old_clusters; k++) {
+      if (keep[k]) {
+        prev[t++] = prev[k];
+      }
+    }
+    for (k = 0, t = 0; k < old_clusters; k++) {
+      if (keep[k]) {
+        memmove (prev + new_clusters + t * m, prev + old_clusters + k * m, m * sizeof (PROBNODE));
+        t++;
+      }
+    }
+    for (k = 0, t = 0; k < old_clusters; k++) {
+      if (keep[k]) {
+        memmove (prev + new_clusters * (1 + m) + t * n, prev + old_clusters * (1 + m) + k * n, n * sizeof (PROBNODE));
+        t++;
+      }
+    }
+  }
+  wfree (keep);
+
+  info -> num_clusters = new_clusters;
+  info -> block_size = new_clusters;
+
+  sum = GET_PROBZ (0);
+  for (k = 1; k < info -> num_clusters; k++) {
+    logSumsInline (sum, GET_PROBZ (k));
+  }
+  for (k = 0; k < info -> num_clusters; k++) {
+    GET_PROBZ (k) = GET_PROBZ (k) - sum;
+  }
+
+  return;
+}
+
+
+/*!
+**  Copy P(z), P(w1|z) and P(w2|z) one after the other to probs, which has
+**  room for num_clusters * (1 + m + n) values.  This is the layout of
+**  (info -> prev_probs) and of every other saved copy of the parameters.
+*/
+void saveProbs (INFO *info, PROBNODE *probs) {
+  size_t k = info -> num_clusters;
+
+  memcpy (probs, info -> probz, k * sizeof (PROBNODE));
+  memcpy (probs + k, info -> probw1_z, k * info -> m * sizeof (PROBNODE));
+  memcpy (probs + k + k * info -> m, info -> probw2_z, k * info -> n * sizeof (PROBNODE));
+
+  return;
+}
+
+
+/*!  Copy P(z), P(w1|z) and P(w2|z) back from probs, as saved by saveProbs ()  */
+void restoreProbs (INFO *info, const PROBNODE *probs) {
+  size_t k = info -> num_clusters;
+
+  memcpy (info -> probz, probs, k * sizeof (PROBNODE));
+  memcpy (info -> probw1_z, probs + k, k * info -> m * sizeof (PROBNODE));
+  memcpy (info -> probw2_z, probs + k + k * info -> m, k * info -> n * sizeof (PROBNODE));
+
+  return;
+}
+
+
+/*!
+**  Normalize probabilities.  If (info -> prev_probs) is allocated, the
+**  largest absolute change of any probability since the previous call
+**  is also stored in (info -> param_change).  If clusters are being
+**  pruned, the ones that have collapsed are removed afterwards.
+*/
 void normalizeProbs (INFO *info) {
   unsigned int i;  /*  Index into w1  */
   unsigned int j;  /*  Index into w2  */
   unsigned int k;  /*  Index into clusters  */
   PROBNODE sum;
   PROBNODE norm;
-  time_t start;
-  time_t end;
+  PROBNODE *prev_z = info -> prev_probs;
+  PROBNODE *prev_w1 = NULL;
+  PROBNODE *prev_w2 = NULL;
+  PROBNODE change = 0.0;
+  struct timespec start;
+  struct timespec end;
+
+  GET_TIME (start);
+  PERF_START (perf_fds);
 
-  time (&start);
+  /*  Same layout as P(z), P(w1|z) and P(w2|z) one after the other  */
+  if (prev_z != NULL) {
+    prev_w1 = prev_z + info -> num_clusters;
+    prev_w2 = prev_w1 + (size_t) info -> num_clusters * info -> m;
+  }
 
   for (k = 0; k < info -> num_clusters; k++) {
     norm = GET_PROBZ (k);
@@ -144,11 +542,17 @@ void normalizeProbs (INFO *info) {
     /*  probw1_z  */
     for (i = 0; i < info -> m; i++) {
       GET_PROBW1_Z (k, i) = GET_PROBW1_Z (k, i) - norm;
+      if (prev_w1 != NULL) {
+        trackChange (&(prev_w1[(size_t) k * info -> m + i]), GET_PROBW1_Z (k, i), &change);
+      }
     }
 
     /*  probw2_z  */
     for (j = 0; j < info -> n; j++) {
       GET_PROBW2_Z (k, j) = GET_PROBW2_Z (k, j) - norm;
+      if (prev_w2 != NULL) {
+        trackChange (&(prev_w2[(size_t) k * info -> n + j]), GET_PROBW2_Z (k, j), &change);
+      }
     }
   }
 
@@ -160,10 +564,20 @@ void normalizeProbs (INFO *info) {
   }
   for (k = 0; k < info -> num_clusters; k++) {
     GET_PROBZ (k) = GET_PROBZ (k) - sum;
+    if (prev_z != NULL) {
+      trackChange (&(prev_z[k]), GET_PROBZ (k), &change);
+    }
+  }
+
+  info -> param_change = change;
+
+  if (info -> prune_threshold > 0) {
+    pruneClusters (info);
   }
 
-  time (&end);
-  info -> normalizeProbs_time += difftime (end, start);
+  PERF_STOP (perf_fds, info -> normalizeProbs_perf);
+  GET_TIME (end);
+  info -> normalizeProbs_time += ELAPSED_TIME (start, end);
 
   return;
 }
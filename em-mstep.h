@@ -19,7 +19,12 @@
 #ifndef EM_MSTEP_H
 #define EM_MSTEP_H
 
+void touchMStepPartitions (INFO *info);
 void applyMStep (INFO *info);
+void saveProbs (INFO *info, PROBNODE *probs);
+void restoreProbs (INFO *info, const PROBNODE *probs);
+void initPrevProbs (INFO *info);
+void freePrevProbs (INFO *info);
 void normalizeProbs (INFO *info);
 
 #endif
@@ -0,0 +1,415 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+**  Online (mini-batch stochastic) EM.  The rows are visited in a random
+**  order, a mini-batch at a time, and the posteriors are computed only
+**  for the nonzeros of the batch.  Each row has its own P(w1|z), so its
+**  sufficient statistics are simply replaced when it is visited.  Those
+**  of P(w2|z) and P(z) are shared by all rows and are updated with a
+**  decaying step size (Liang and Klein, 2009):
+**
+**    S = (1 - eta) S + eta * (N / N_batch) * S_batch,  eta = (t + tau)^-kappa
+**
+**  where N is the total count and t the number of batches so far.  The
+**  decay is kept as a single offset so that a batch costs time in
+**  proportion to its nonzeros only.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <float.h>  /*  DBL_EPSILON  */
+#include <stdbool.h>
+#include <time.h>
+
+#include "wmalloc.h"
+#include "plsa-defn.h"
+#include "em-estep.h"
+#include "profile.h"
+#include "em-online.h"
+
+
+/*!  Sufficient statistics of online EM (all log values unless noted)  */
+typedef struct online {
+  /*!  Expected counts of each row and cluster, of size (k * m)  */
+  PROBNODE *stat_w1;
+  /*!  Sum of stat_w1 over the rows, for each cluster (not a log value)  */
+  double *total_w1;
+  /*!  Expected counts of each column and cluster less offset, of size (k * n)  */
+  PROBNODE *stat_w2;
+  /*!  Sum of stat_w2 over the columns, for each cluster, less offset  */
+  PROBNODE *total_w2;
+  /*!  Decay applied to all of stat_w2 and total_w2  */
+  PROBNODE offset;
+
+  /*  Statistics of the current batch  */
+  /*!  Expected counts of each column and cluster, of size (n * k)  */
+  PROBNODE *batch_w2;
+  /*!  Whether a column has appeared in the batch  */
+  bool *touched;
+  /*!  Columns that have appeared in the batch  */
+  unsigned int *touched_list;
+  /*!  Length of touched_list  */
+  unsigned int num_touched;
+
+  /*!  Posteriors of one cell, the new statistics of one row and the log of total_w1, of size (k)  */
+  PROBNODE *post;
+  PROBNODE *row_stat;
+  PROBNODE *log_total_w1;
+} ONLINE;
+
+
+/*!  Sufficient statistics of the current (random) parameters, scaled to the total count  */
+static ONLINE *initOnline (INFO *info, PROBNODE log_total) {
+  ONLINE *online = wmalloc (sizeof (ONLINE));
+  unsigned int num_clusters = info -> num_clusters;
+  unsigned int i;
+  unsigned int j;
+  unsigned int k;
+
+  online -> stat_w1 = wmallocTag ((size_t) num_clusters * info -> m * sizeof (PROBNODE), WM_TAG_ENGINE);
+  online -> total_w1 = wmalloc (num_clusters * sizeof (double));
+  online -> stat_w2 = wmallocTag ((size_t) num_clusters * info -> n * sizeof (PROBNODE), WM_TAG_ENGINE);
+  online -> total_w2 = wmalloc (num_clusters * sizeof (PROBNODE));
+  online -> offset = 0.0;
+  online -> batch_w2 = wmallocTag ((size_t) info -> n * num_clusters * sizeof (PROBNODE), WM_TAG_ENGINE);
+  online -> touched = wmalloc (info -> n * sizeof (bool));
+  online -> touched_list = wmalloc (info -> n * sizeof (unsigned int));
+  online -> num_touched = 0;
+  online -> post = wmalloc (num_clusters * sizeof (PROBNODE));
+  online -> row_stat = wmalloc (num_clusters * sizeof (PROBNODE));
+  online -> log_total_w1 = wmalloc (num_clusters * sizeof (PROBNODE));
+
+  for (k = 0; k < num_clusters; k++) {
+    online -> total_w1[k] = exp (log_total + GET_PROBZ (k));
+    online -> total_w2[k] = log_total + GET_PROBZ (k);
+    for (i = 0; i < info -> m; i++) {
+      online -> stat_w1[(size_t) k * info -> m + i] = log_total + GET_PROBZ (k) + GET_PROBW1_Z (k, i);
+    }
+    for (j = 0; j < info -> n; j++) {
+      online -> stat_w2[(size_t) k * info -> n + j] = log_total + GET_PROBZ (k) + GET_PROBW2_Z (k, j);
+    }
+  }
+  for (j = 0; j < info -> n; j++) {
+    online -> touched[j] = false;
+  }
+
+  return (online);
+}
+
+
+static void freeOnline (ONLINE *online) {
+  wfree (online -> stat_w1);
+  wfree (online -> total_w1);
+  wfree (online -> stat_w2);
+  wfree (online -> total_w2);
+  wfree (online -> batch_w2);
+  wfree (online -> touched);
+  wfree (online -> touched_list);
+  wfree (online -> post);
+  wfree (online -> row_stat);
+  wfree (online -> log_total_w1);
+  wfree (online);
+
+  return;
+}
+
+
+/*!  Set P(z), P(w1|z) and P(w2|z) from the sufficient statistics  */
+static void refreshFactors (INFO *info, ONLINE *online) {
+  unsigned int num_clusters = info -> num_clusters;
+  unsigned int i;
+  unsigned int j;
+  unsigned int k;
+  PROBNODE sum;
+  PROBNODE norm;
+
+  sum = online -> total_w2[0];
+  for (k = 1; k < num_clusters; k++) {
+    logSumsInline (sum, online -> total_w2[k]);
+  }
+
+  for (k = 0; k < num_clusters; k++) {
+    GET_PROBZ (k) = online -> total_w2[k] - sum;
+
+    /*  Recompute the row totals exactly, rather than trust the running sums  */
+    norm = online -> stat_w1[(size_t) k * info -> m];
+    for (i = 1; i < info -> m; i++) {
+      logSumsInline (norm, online -> stat_w1[(size_t) k * info -> m + i]);
+    }
+    online -> total_w1[k] = exp (norm);
+    for (i = 0; i < info -> m; i++) {
+      GET_PROBW1_Z (k, i) = online -> stat_w1[(size_t) k * info -> m + i] - norm;
+    }
+
+    for (j = 0; j < info -> n; j++) {
+      GET_PROBW2_Z (k, j) = online -> stat_w2[(size_t) k * info -> n + j] - online -> total_w2[k];
+    }
+  }
+
+  return;
+}
+
+
+/*!
+**  E-step for the nonzeros of a single row.  The row's statistics are
+**  replaced and its expected counts for each column are added to those
+**  of the batch.  Returns the total count of the row.
+*/
+static PROBNODE onlineRow (INFO *info, ONLINE *online, unsigned int i) {
+  unsigned int num_clusters = info -> num_clusters;
+  unsigned int cos_count = GET_COS_POSITION (i, 0);
+  unsigned int pos_j;
+  unsigned int j;
+  unsigned int k;
+  PROBNODE cos;
+  PROBNODE norm;
+  PROBNODE count = 0.0;
+  PROBNODE *post = online -> post;
+  PROBNODE *row_stat = online -> row_stat;
+  PROBNODE *log_total_w1 = online -> log_total_w1;
+
+  if (cos_count == 0) {
+    return (0.0);
+  }
+
+  for (k = 0; k < num_clusters; k++) {
+    log_total_w1[k] = log (online -> total_w1[k]);
+  }
+
+  for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+    j = GET_COS_POSITION (i, pos_j);
+    cos = GET_COS (i, pos_j);
+    count += DOEXP (cos);
+
+    /*  P(z) P(w1|z) P(w2|z) is proportional to S_w1 S_w2 / T_w1 (to the power beta)  */
+    for (k = 0; k < num_clusters; k++) {
+      post[k] = info -> beta * (online -> stat_w1[(size_t) k * info -> m + i] + online -> stat_w2[(size_t) k * info -> n + j] - log_total_w1[k]);
+    }
+    norm = post[0];
+    for (k = 1; k < num_clusters; k++) {
+      logSumsInline (norm, post[k]);
+    }
+
+    for (k = 0; k < num_clusters; k++) {
+      post[k] = cos + post[k] - norm;
+      if (pos_j == 1) {
+        row_stat[k] = post[k];
+      }
+      else {
+        logSumsInline (row_stat[k], post[k]);
+      }
+
+      if (online -> touched[j]) {
+        logSumsInline (online -> batch_w2[(size_t) j * num_clusters + k], post[k]);
+      }
+      else {
+        online -> batch_w2[(size_t) j * num_clusters + k] = post[k];
+      }
+    }
+    if (!online -> touched[j]) {
+      online -> touched[j] = true;
+      online -> touched_list[online -> num_touched++] = j;
+    }
+  }
+
+  /*  A row's statistics come only from its own nonzeros, so they are replaced  */
+  for (k = 0; k < num_clusters; k++) {
+    online -> total_w1[k] += exp (row_stat[k]) - exp (online -> stat_w1[(size_t) k * info -> m + i]);
+    if (online -> total_w1[k] < DBL_MIN) {
+      online -> total_w1[k] = DBL_MIN;
+    }
+    online -> stat_w1[(size_t) k * info -> m + i] = row_stat[k];
+  }
+
+  return (count);
+}
+
+
+/*!  Blend the statistics of the batch into those of P(w2|z) and P(z)  */
+static void onlineUpdate (INFO *info, ONLINE *online, PROBNODE eta, PROBNODE scale) {
+  unsigned int num_clusters = info -> num_clusters;
+  unsigned int j;
+  unsigned int k;
+  unsigned int t;
+  size_t p;
+  PROBNODE add;
+  PROBNODE *batch_total = online -> post;
+
+  /*  Decay the existing statistics  */
+  online -> offset += log1p (-eta);
+  add = log (eta) + log (scale) - online -> offset;
+
+  for (t = 0; t < online -> num_touched; t++) {
+    j = online -> touched_list[t];
+    for (k = 0; k < num_clusters; k++) {
+      logSumsInline (online -> stat_w2[(size_t) k * info -> n + j], add + online -> batch_w2[(size_t) j * num_clusters + k]);
+      if (t == 0) {
+        batch_total[k] = online -> batch_w2[(size_t) j * num_clusters + k];
+      }
+      else {
+        logSumsInline (batch_total[k], online -> batch_w2[(size_t) j * num_clusters + k]);
+      }
+    }
+    online -> touched[j] = false;
+  }
+  if (online -> num_touched > 0) {
+    for (k = 0; k < num_clusters; k++) {
+      logSumsInline (online -> total_w2[k], add + batch_total[k]);
+    }
+  }
+  online -> num_touched = 0;
+
+  /*  Fold the offset in before the stored values lose precision  */
+  if (online -> offset < -ONLINE_REBASE) {
+    for (p = 0; p < (size_t) num_clusters * info -> n; p++) {
+      online -> stat_w2[p] += online -> offset;
+    }
+    for (k = 0; k < num_clusters; k++) {
+      online -> total_w2[k] += online -> offset;
+    }
+    online -> offset = 0.0;
+  }
+
+  return;
+}
+
+
+/*!
+**  Train with online EM, visiting every row once per epoch in a random
+**  order, (info -> minibatch) rows at a time.  The log-likelihood is
+**  calculated after each epoch and the same termination conditions as
+**  batch EM apply, with (info -> maxiter) as the maximum number of
+**  epochs.  Training also stops after (info -> max_batches) batches if
+**  that is not 0, even within an epoch, which then counts as the last
+**  iteration.  Returns the final log-likelihood.
+**
+**  onlineRow () works from the statistics, so every batch already sees
+**  the updates of the ones before it; P(z), P(w1|z) and P(w2|z) are
+**  only needed for the log-likelihood and the output, so they are
+**  recalculated from the statistics whenever training pauses for one.
+*/
+PROBNODE trainOnline (INFO *info) {
+  ONLINE *online = NULL;
+  unsigned int *order = NULL;
+  unsigned int rng = info -> seed;
+  unsigned int batches = 0;  /*  Number of batches so far  */
+  unsigned int epoch = 0;
+  unsigned int stalls = 0;
+  unsigned int start = 0;
+  unsigned int pos = 0;
+  unsigned int i = 0;
+  unsigned int temp = 0;
+  PROBNODE log_total;
+  PROBNODE total = 0.0;
+  PROBNODE batch_total;
+  PROBNODE eta;
+  PROBNODE curr_ML;
+  PROBNODE prev_ML;
+  PROBNODE diff;
+
+  for (i = 0; i < info -> m; i++) {
+    for (pos = 1; pos <= GET_COS_POSITION (i, 0); pos++) {
+      total += DOEXP (GET_COS (i, pos));
+    }
+  }
+  log_total = log (total);
+
+  online = initOnline (info, log_total);
+  order = wmalloc (info -> m * sizeof (unsigned int));
+  for (i = 0; i < info -> m; i++) {
+    order[i] = i;
+  }
+
+  curr_ML = calculateML (info);
+  if (info -> verbose) {
+    fprintf (stderr, "[---]  Initial = %f\n", curr_ML);
+  }
+  info -> iter = 0;
+  profileIteration (info, true, curr_ML);
+
+  info -> iterations = 0;
+  for (epoch = 1; epoch <= info -> maxiter; epoch++) {
+    /*  Shuffle the rows (Fisher-Yates); rand_r () keeps concurrent models independent  */
+    for (i = info -> m - 1; i > 0; i--) {
+      pos = rand_r (&rng) % (i + 1);
+      temp = order[i];
+      order[i] = order[pos];
+      order[pos] = temp;
+    }
+
+    for (start = 0; start < info -> m; start += info -> minibatch) {
+      batch_total = 0.0;
+      for (pos = start; (pos < start + info -> minibatch) && (pos < info -> m); pos++) {
+        batch_total += onlineRow (info, online, order[pos]);
+      }
+      if (batch_total == 0.0) {
+        continue;
+      }
+
+      batches++;
+      eta = pow (batches + info -> online_tau, -info -> online_kappa);
+      onlineUpdate (info, online, eta, total / batch_total);
+      if (batches == info -> max_batches) {
+        break;
+      }
+    }
+
+    refreshFactors (info, online);
+    info -> iterations++;
+
+    prev_ML = curr_ML;
+    curr_ML = calculateML (info);
+    info -> iter = epoch;
+    profileIteration (info, true, curr_ML);
+    diff = (curr_ML - prev_ML) / prev_ML * 100 * -1;
+    if (info -> verbose) {
+      fprintf (stderr, "[%3u]  %f --> %f\t[%f, %2.4f %%]\n", epoch, prev_ML, curr_ML, (curr_ML - prev_ML), diff);
+    }
+
+    if (batches == info -> max_batches) {
+      if (info -> verbose) {
+        fprintf (stderr, "==\tOnline EM stopped after batches:                %u\n", batches);
+      }
+      break;
+    }
+
+    /*  The stochastic updates need not increase the log-likelihood, so a decrease does not stop training  */
+    if ((DBL_LESS (fabs (diff), info -> rtol)) || (fabs (curr_ML - prev_ML) < info -> atol)) {
+      stalls++;
+      if (stalls >= info -> patience) {
+        break;
+      }
+    }
+    else {
+      stalls = 0;
+    }
+  }
+
+  info -> iter = UINT_MAX;
+  info -> final_ML = curr_ML;
+
+  wfree (order);
+  freeOnline (online);
+
+  return (curr_ML);
+}
+
@@ -0,0 +1,278 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+**  EM with sparse posteriors.  Once EM settles, most nonzeros put almost
+**  all of their posterior mass on a few clusters.  Every sparse_refresh
+**  steps, the posteriors of each nonzero are calculated over all clusters
+**  (exactly as applyEStep () and applyMStep () would) and the clusters
+**  whose log posterior is at least -sparse_cutoff are kept as the active
+**  set of the nonzero.  The steps in between only visit the active sets.
+**  The E-step and M-step are done together for each nonzero, so
+**  P(z|w1w2) is never stored.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "wmalloc.h"
+#include "plsa-defn.h"
+#include "em-mstep.h"
+#include "perf.h"
+#include "em-sparse.h"
+
+
+/*!  Accumulate a log value into a sum that might not have been set yet  */
+#define ACCUMULATE(POS,VALUE) \
+  if (sparse -> flag[POS]) { \
+    logSumsInline (sparse -> acc[POS], VALUE); \
+  } \
+  else { \
+    sparse -> acc[POS] = VALUE; \
+    sparse -> flag[POS] = true; \
+  }
+
+
+SPARSE *initSparse (INFO *info) {
+  SPARSE *sparse = wmalloc (sizeof (SPARSE));
+  size_t size = (size_t) info -> num_clusters * (1 + (size_t) info -> m + info -> n);
+  unsigned int cos_count;
+  unsigned int i;
+  unsigned int j;
+  unsigned int pos_j;
+  double *column_total = wmalloc (info -> n * sizeof (double));
+  double row_total;
+  double total = 0.0;
+
+  for (j = 0; j < info -> n; j++) {
+    column_total[j] = 0.0;
+  }
+
+  sparse -> num_nonzeros = 0;
+  sparse -> log_row_total = wmallocTag (info -> m * sizeof (PROBNODE), WM_TAG_ENGINE);
+  sparse -> log_column_total = wmallocTag (info -> n * sizeof (PROBNODE), WM_TAG_ENGINE);
+  for (i = 0; i < info -> m; i++) {
+    cos_count = GET_COS_POSITION (i, 0);
+    row_total = 0.0;
+    for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+      row_total += DOEXP (GET_COS (i, pos_j));
+      column_total[GET_COS_POSITION (i, pos_j)] += DOEXP (GET_COS (i, pos_j));
+    }
+    sparse -> log_row_total[i] = log (row_total);
+    sparse -> num_nonzeros += cos_count;
+    total += row_total;
+  }
+  for (j = 0; j < info -> n; j++) {
+    sparse -> log_column_total[j] = log (column_total[j]);
+  }
+  sparse -> log_total = log (total);
+  wfree (column_total);
+
+  sparse -> active_start = wmallocTag ((sparse -> num_nonzeros + 1) * sizeof (size_t), WM_TAG_ENGINE);
+  sparse -> active_capacity = sparse -> num_nonzeros + info -> num_clusters;
+  sparse -> active = wmallocTag (sparse -> active_capacity * sizeof (unsigned int), WM_TAG_ENGINE);
+  sparse -> acc = wmallocTag (size * sizeof (PROBNODE), WM_TAG_ENGINE);
+  sparse -> flag = wmallocTag (size * sizeof (bool), WM_TAG_ENGINE);
+  sparse -> post = wmalloc (info -> num_clusters * sizeof (PROBNODE));
+  sparse -> steps = 0;
+
+  return (sparse);
+}
+
+
+void freeSparse (SPARSE *sparse) {
+  wfree (sparse -> active_start);
+  wfree (sparse -> active);
+  wfree (sparse -> acc);
+  wfree (sparse -> flag);
+  wfree (sparse -> log_row_total);
+  wfree (sparse -> log_column_total);
+  wfree (sparse -> post);
+  wfree (sparse);
+
+  return;
+}
+
+
+/*!  Posteriors over all clusters; rebuilds the active set of nonzero e  */
+static void refreshNonzero (INFO *info, SPARSE *sparse, size_t e, unsigned int i, unsigned int j, PROBNODE cos, size_t *next) {
+  unsigned int num_clusters = info -> num_clusters;
+  PROBNODE *post = sparse -> post;
+  PROBNODE sum;
+  PROBNODE value;
+  unsigned int best = 0;
+  unsigned int k;
+
+  post[0] = info -> beta * (GET_PROBW1_Z (0, i) + GET_PROBW2_Z (0, j) + GET_PROBZ (0));
+  sum = post[0];
+  for (k = 1; k < num_clusters; k++) {
+    post[k] = info -> beta * (GET_PROBW1_Z (k, i) + GET_PROBW2_Z (k, j) + GET_PROBZ (k));
+    logSumsInline (sum, post[k]);
+    if (post[k] > post[best]) {
+      best = k;
+    }
+  }
+
+  sparse -> active_start[e] = *next;
+  for (k = 0; k < num_clusters; k++) {
+    value = post[k] - sum;
+    ACCUMULATE (k, cos + value);
+    ACCUMULATE (num_clusters + (size_t) k * info -> m + i, cos + value);
+    ACCUMULATE ((size_t) num_clusters * (1 + info -> m) + (size_t) k * info -> n + j, cos + value);
+
+    if (value >= -info -> sparse_cutoff) {
+      if (*next == sparse -> active_capacity) {
+        sparse -> active_capacity *= 2;
+        sparse -> active = wrealloc (sparse -> active, sparse -> active_capacity * sizeof (unsigned int));
+      }
+      sparse -> active[(*next)++] = k;
+    }
+  }
+
+  /*  A small cutoff could drop every cluster; keep the most likely one  */
+  if (*next == sparse -> active_start[e]) {
+    sparse -> active[(*next)++] = best;
+  }
+
+  return;
+}
+
+
+/*!  Posteriors over the active clusters of nonzero e only  */
+static void updateNonzero (INFO *info, SPARSE *sparse, size_t e, unsigned int i, unsigned int j, PROBNODE cos) {
+  unsigned int num_clusters = info -> num_clusters;
+  unsigned int *active = sparse -> active + sparse -> active_start[e];
+  unsigned int count = sparse -> active_start[e + 1] - sparse -> active_start[e];
+  PROBNODE *post = sparse -> post;
+  PROBNODE sum;
+  PROBNODE value;
+  unsigned int a;
+  unsigned int k;
+
+  for (a = 0; a < count; a++) {
+    k = active[a];
+    post[a] = info -> beta * (GET_PROBW1_Z (k, i) + GET_PROBW2_Z (k, j) + GET_PROBZ (k));
+  }
+  sum = post[0];
+  for (a = 1; a < count; a++) {
+    logSumsInline (sum, post[a]);
+  }
+
+  for (a = 0; a < count; a++) {
+    k = active[a];
+    value = post[a] - sum;
+    ACCUMULATE (k, cos + value);
+    ACCUMULATE (num_clusters + (size_t) k * info -> m + i, cos + value);
+    ACCUMULATE ((size_t) num_clusters * (1 + info -> m) + (size_t) k * info -> n + j, cos + value);
+  }
+
+  return;
+}
+
+
+/*!
+**  Replace a parameter by its accumulated value.  Between refreshes, a
+**  parameter that no active set reached is given the most mass that the
+**  dropped posteriors could have added (its total count times
+**  exp (-sparse_cutoff)), so that the next refresh can bring it back.
+**  On a refresh, as in applyMStep (), it is left as it was.
+*/
+static inline void setParameter (SPARSE *sparse, size_t pos, PROBNODE *param, PROBNODE log_total, PROBNODE cutoff, bool refresh) {
+  if (sparse -> flag[pos]) {
+    *param = sparse -> acc[pos];
+  }
+  else if ((!refresh) && (isfinite (log_total))) {
+    *param = log_total - cutoff;
+  }
+
+  return;
+}
+
+
+/*!  One EM step with sparse posteriors, including normalization  */
+void applySparseStep (INFO *info, SPARSE *sparse) {
+  unsigned int num_clusters = info -> num_clusters;
+  size_t size = (size_t) num_clusters * (1 + (size_t) info -> m + info -> n);
+  unsigned int cos_count;
+  size_t e = 0;
+  unsigned int i;
+  unsigned int j;
+  unsigned int k;
+  unsigned int pos_j;
+  size_t next = 0;
+  bool refresh = (sparse -> steps % info -> sparse_refresh == 0);
+  struct timespec start;
+  struct timespec end;
+
+  GET_TIME (start);
+  PERF_START (perf_fds);
+
+  for (e = 0; e < size; e++) {
+    sparse -> flag[e] = false;
+  }
+
+  e = 0;
+  for (i = 0; i < info -> m; i++) {
+    cos_count = GET_COS_POSITION (i, 0);
+    for (pos_j = 1; pos_j <= cos_count; pos_j++, e++) {
+      j = GET_COS_POSITION (i, pos_j);
+      if (refresh) {
+        refreshNonzero (info, sparse, e, i, j, GET_COS (i, pos_j), &next);
+      }
+      else {
+        updateNonzero (info, sparse, e, i, j, GET_COS (i, pos_j));
+      }
+    }
+  }
+  if (refresh) {
+    sparse -> active_start[e] = next;
+    if (info -> verbose) {
+      fprintf (stderr, "==\tActive clusters per nonzero:                    %.2f of %u\n", (double) next / (double) sparse -> num_nonzeros, num_clusters);
+    }
+  }
+
+  for (k = 0; k < num_clusters; k++) {
+    setParameter (sparse, k, &GET_PROBZ (k), sparse -> log_total, info -> sparse_cutoff, refresh);
+    for (i = 0; i < info -> m; i++) {
+      setParameter (sparse, num_clusters + (size_t) k * info -> m + i, &GET_PROBW1_Z (k, i), sparse -> log_row_total[i], info -> sparse_cutoff, refresh);
+    }
+    for (j = 0; j < info -> n; j++) {
+      setParameter (sparse, (size_t) num_clusters * (1 + info -> m) + (size_t) k * info -> n + j, &GET_PROBW2_Z (k, j), sparse -> log_column_total[j], info -> sparse_cutoff, refresh);
+    }
+  }
+  sparse -> steps++;
+
+  PERF_STOP (perf_fds, info -> applyEStep_perf);
+  GET_TIME (end);
+  info -> applyEStep_time += ELAPSED_TIME (start, end);
+
+  normalizeProbs (info);
+
+  /*  The active sets refer to clusters that --prune may have just moved  */
+  if (info -> num_clusters != num_clusters) {
+    sparse -> steps = 0;
+  }
+
+  return;
+}
+
@@ -0,0 +1,475 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+**  Out-of-core (streaming) EM.  Only the parameters are kept in memory;
+**  on each iteration the rows of the co-occurrence file are read again,
+**  in large blocks, by a background thread while the previous block is
+**  processed.  The E-step, M-step and log-likelihood are computed
+**  together for each nonzero, so one pass over the file is one
+**  iteration of EM.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <float.h>  /*  DBL_EPSILON  */
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "wmalloc.h"
+#include "plsa-defn.h"
+#include "em-mstep.h"
+#include "profile.h"
+#include "perf.h"
+#include "em-stream.h"
+
+
+/*!  A block of consecutive rows read from the co-occurrence file  */
+typedef struct stream_block {
+  /*!  Index of the first row in the block  */
+  unsigned int first_row;
+  /*!  Number of rows in the block  */
+  unsigned int num_rows;
+  /*!  Number of nonzeros of each row  */
+  unsigned int *row_count;
+  /*!  Space for row_count  */
+  unsigned int row_capacity;
+  /*!  Nonzeros of all rows one after the other, with the counts as log values  */
+  COOCCUR *cells;
+  /*!  Number of nonzeros in the block  */
+  unsigned int num_cells;
+  /*!  Space for cells  */
+  unsigned int cell_capacity;
+} STREAM_BLOCK;
+
+
+/*!  Two blocks passed between the reading thread and the E/M step  */
+typedef struct stream {
+  INFO *info;
+  STREAM_BLOCK blocks[2];
+  /*!  Whether each block has been filled and not yet processed  */
+  bool full[2];
+  /*!  Set when the reading thread has read every row  */
+  bool done;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} STREAM;
+
+
+/*!  Accumulators of the streaming M-step  */
+typedef struct stream_acc {
+  PROBNODE *probz;
+  PROBNODE *probw1_z;
+  PROBNODE *probw2_z;
+  /*!  Whether each value has been set yet, since they are log values  */
+  bool *flag_z;
+  bool *flag_w1_z;
+  bool *flag_w2_z;
+  /*!  Posteriors of one cell  */
+  PROBNODE *post;
+} STREAM_ACC;
+
+
+static unsigned int readValue (INFO *info, FILE *fp) {
+  unsigned int value = 0;
+
+  if (info -> textio) {
+    fscanf (fp, "%u", &value);
+  }
+  else {
+    fread (&value, sizeof (unsigned int), 1, fp);
+  }
+
+  return (value);
+}
+
+
+/*!  Read as many rows as fit into a block; rows larger than a block grow it  */
+static void fillBlock (INFO *info, FILE *fp, STREAM_BLOCK *block, unsigned int first_row) {
+  unsigned int cos_count = 0;
+  unsigned int w2 = 0;
+  unsigned int freq = 0;
+  unsigned int i = first_row;
+  unsigned int pos = 0;
+  COOCCUR *cell = NULL;
+
+  block -> first_row = first_row;
+  block -> num_rows = 0;
+  block -> num_cells = 0;
+
+  while (i < info -> m) {
+    (void) readValue (info, fp);  /*  w1; rows are numbered by their position  */
+    cos_count = readValue (info, fp);
+    if (feof (fp)) {
+      fprintf (stderr, "Not all query terms found!  (%u, %u)\n", i, info -> m);
+      exit (EXIT_FAILURE);
+    }
+
+    if (block -> num_cells + cos_count > block -> cell_capacity) {
+      block -> cell_capacity = block -> num_cells + cos_count;
+      block -> cells = wrealloc (block -> cells, block -> cell_capacity * sizeof (COOCCUR));
+    }
+
+    for (pos = 0; pos < cos_count; pos++) {
+      w2 = readValue (info, fp);
+      freq = readValue (info, fp);
+      if (w2 >= info -> n) {
+        fprintf (stderr, "Word 2 (%u) is out of range (%u).\n", w2, info -> n);
+        exit (EXIT_FAILURE);
+      }
+      cell = &(block -> cells[block -> num_cells + pos]);
+      cell -> column = w2;
+      cell -> x = DOLOG (freq);
+    }
+
+    block -> row_count[block -> num_rows] = cos_count;
+    block -> num_rows++;
+    block -> num_cells += cos_count;
+    i++;
+
+    if ((block -> num_rows == block -> row_capacity) || (block -> num_cells >= STREAM_BLOCK_CELLS)) {
+      break;
+    }
+  }
+
+  return;
+}
+
+
+/*!  Reading thread:  fill the two blocks in turn until every row has been read  */
+static void *streamReader (void *arg) {
+  STREAM *stream = (STREAM*) arg;
+  INFO *info = stream -> info;
+  FILE *fp = NULL;
+  char *buffer = wmalloc (STREAM_BUFSIZE);
+  unsigned int row = 0;
+  unsigned int b = 0;
+
+  if (info -> textio) {
+    FOPEN (info -> co_fn, fp, "r");
+  }
+  else {
+    FOPEN (info -> co_fn, fp, "rb");
+  }
+  /*  Large sequential reads  */
+  setvbuf (fp, buffer, _IOFBF, STREAM_BUFSIZE);
+  fseek (fp, info -> data_offset, SEEK_SET);
+
+  while (row < info -> m) {
+    pthread_mutex_lock (&(stream -> lock));
+    while (stream -> full[b]) {
+      pthread_cond_wait (&(stream -> cond), &(stream -> lock));
+    }
+    pthread_mutex_unlock (&(stream -> lock));
+
+    fillBlock (info, fp, &(stream -> blocks[b]), row);
+    row += stream -> blocks[b].num_rows;
+
+    pthread_mutex_lock (&(stream -> lock));
+    stream -> full[b] = true;
+    pthread_cond_broadcast (&(stream -> cond));
+    pthread_mutex_unlock (&(stream -> lock));
+
+    b = 1 - b;
+  }
+
+  pthread_mutex_lock (&(stream -> lock));
+  stream -> done = true;
+  pthread_cond_broadcast (&(stream -> cond));
+  pthread_mutex_unlock (&(stream -> lock));
+
+  FCLOSE (fp);
+  wfree (buffer);
+
+  return (NULL);
+}
+
+
+/*!  Accumulate log (value) into a log value that might not have been set yet  */
+#define ACCUMULATE(FLAG,ACC,VALUE) \
+  if (FLAG) { \
+    logSumsInline (ACC, VALUE); \
+  } \
+  else { \
+    ACC = VALUE; \
+    FLAG = true; \
+  }
+
+
+/*!
+**  Log-likelihood of the nonzeros of one block and, unless acc is NULL,
+**  their E-step and M-step.  The sums are taken in the same order as
+**  calculateML (), applyEStep () and applyMStep () so that the results
+**  match those of batch EM.
+*/
+static PROBNODE processBlock (INFO *info, STREAM_BLOCK *block, STREAM_ACC *acc) {
+  unsigned int num_clusters = info -> num_clusters;
+  unsigned int r;
+  unsigned int i;
+  unsigned int j;
+  unsigned int k;
+  unsigned int pos = 0;
+  unsigned int pos_j;
+  PROBNODE cos;
+  PROBNODE temp;
+  PROBNODE sum;
+  PROBNODE value;
+  PROBNODE total = 0.0;
+
+  for (r = 0; r < block -> num_rows; r++) {
+    i = block -> first_row + r;
+    for (pos_j = 0; pos_j < block -> row_count[r]; pos_j++, pos++) {
+      j = block -> cells[pos].column;
+      cos = block -> cells[pos].x;
+
+      temp = (GET_PROBZ (0) + GET_PROBW1_Z (0, i) + GET_PROBW2_Z (0, j));
+      for (k = 1; k < num_clusters; k++) {
+        logSumsInline (temp, GET_PROBZ (k) + GET_PROBW1_Z (k, i) + GET_PROBW2_Z (k, j));
+      }
+      total += (temp * DOEXP (cos));
+
+      if (acc == NULL) {
+        continue;
+      }
+
+      acc -> post[0] = info -> beta * (GET_PROBW1_Z (0, i) + GET_PROBW2_Z (0, j) + GET_PROBZ (0));
+      sum = acc -> post[0];
+      for (k = 1; k < num_clusters; k++) {
+        acc -> post[k] = info -> beta * (GET_PROBW1_Z (k, i) + GET_PROBW2_Z (k, j) + GET_PROBZ (k));
+        logSumsInline (sum, acc -> post[k]);
+      }
+
+      for (k = 0; k < num_clusters; k++) {
+        value = cos + (acc -> post[k] - sum);
+        ACCUMULATE (acc -> flag_z[k], acc -> probz[k], value);
+        ACCUMULATE (acc -> flag_w1_z[(size_t) k * info -> m + i], acc -> probw1_z[(size_t) k * info -> m + i], value);
+        ACCUMULATE (acc -> flag_w2_z[(size_t) k * info -> n + j], acc -> probw2_z[(size_t) k * info -> n + j], value);
+      }
+    }
+  }
+
+  return (total);
+}
+
+
+/*!
+**  One pass over the co-occurrence file.  Returns the log-likelihood of
+**  the current parameters and, if update is true, applies one iteration
+**  of EM to them.
+*/
+static PROBNODE streamPass (INFO *info, STREAM *stream, STREAM_ACC *acc, bool update) {
+  pthread_t reader;
+  PROBNODE total = 0.0;
+  unsigned long nonzeros = 0;
+  size_t size = 0;
+  size_t x = 0;
+  unsigned int b = 0;
+  struct timespec start;
+  struct timespec end;
+
+  GET_TIME (start);
+  PERF_START (perf_fds);
+
+  if (update) {
+    for (x = 0; x < info -> num_clusters; x++) {
+      acc -> flag_z[x] = false;
+    }
+    size = (size_t) info -> num_clusters * info -> m;
+    for (x = 0; x < size; x++) {
+      acc -> flag_w1_z[x] = false;
+    }
+    size = (size_t) info -> num_clusters * info -> n;
+    for (x = 0; x < size; x++) {
+      acc -> flag_w2_z[x] = false;
+    }
+  }
+
+  stream -> full[0] = false;
+  stream -> full[1] = false;
+  stream -> done = false;
+  pthread_create (&reader, NULL, streamReader, stream);
+
+  while (true) {
+    pthread_mutex_lock (&(stream -> lock));
+    while ((!stream -> full[b]) && (!stream -> done)) {
+      pthread_cond_wait (&(stream -> cond), &(stream -> lock));
+    }
+    if (!stream -> full[b]) {
+      pthread_mutex_unlock (&(stream -> lock));
+      break;
+    }
+    pthread_mutex_unlock (&(stream -> lock));
+
+    total += processBlock (info, &(stream -> blocks[b]), update ? acc : NULL);
+    nonzeros += stream -> blocks[b].num_cells;
+
+    pthread_mutex_lock (&(stream -> lock));
+    stream -> full[b] = false;
+    pthread_cond_broadcast (&(stream -> cond));
+    pthread_mutex_unlock (&(stream -> lock));
+
+    b = 1 - b;
+  }
+  pthread_join (reader, NULL);
+  info -> num_nonzeros = nonzeros;
+
+  PERF_STOP (perf_fds, *(update ? &(info -> applyEStep_perf) : &(info -> calculateML_perf)));
+  GET_TIME (end);
+  if (!update) {
+    info -> calculateML_time += ELAPSED_TIME (start, end);
+    return (total);
+  }
+  info -> applyEStep_time += ELAPSED_TIME (start, end);
+
+  /*  As in applyMStep (), values without any nonzeros are left as they were  */
+  for (x = 0; x < info -> num_clusters; x++) {
+    if (acc -> flag_z[x]) {
+      info -> probz[x] = acc -> probz[x];
+    }
+  }
+  size = (size_t) info -> num_clusters * info -> m;
+  for (x = 0; x < size; x++) {
+    if (acc -> flag_w1_z[x]) {
+      info -> probw1_z[x] = acc -> probw1_z[x];
+    }
+  }
+  size = (size_t) info -> num_clusters * info -> n;
+  for (x = 0; x < size; x++) {
+    if (acc -> flag_w2_z[x]) {
+      info -> probw2_z[x] = acc -> probw2_z[x];
+    }
+  }
+
+  normalizeProbs (info);
+
+  return (total);
+}
+
+
+/*!
+**  Train with streaming EM.  Each pass over the file gives the
+**  log-likelihood of the parameters it updates, so the termination
+**  conditions of batch EM are checked one step late and a last pass
+**  computes the log-likelihood of the final parameters.  Returns that
+**  log-likelihood.
+*/
+PROBNODE trainStream (INFO *info) {
+  STREAM stream;
+  STREAM_ACC acc;
+  unsigned int num_clusters = info -> num_clusters;
+  unsigned int b = 0;
+  unsigned int stalls = 0;  /*  Consecutive evaluations that met the tolerance  */
+  bool update = false;
+  bool stop = false;
+  PROBNODE curr_ML = 0.0;
+  PROBNODE prev_ML = 0.0;
+  PROBNODE diff = 0.0;
+
+  stream.info = info;
+  for (b = 0; b < 2; b++) {
+    stream.blocks[b].row_capacity = STREAM_BLOCK_CELLS;
+    stream.blocks[b].row_count = wmallocTag (stream.blocks[b].row_capacity * sizeof (unsigned int), WM_TAG_ENGINE);
+    stream.blocks[b].cell_capacity = STREAM_BLOCK_CELLS;
+    stream.blocks[b].cells = wmallocTag (stream.blocks[b].cell_capacity * sizeof (COOCCUR), WM_TAG_ENGINE);
+  }
+  pthread_mutex_init (&(stream.lock), NULL);
+  pthread_cond_init (&(stream.cond), NULL);
+
+  acc.probz = wmalloc (num_clusters * sizeof (PROBNODE));
+  acc.probw1_z = wmallocTag ((size_t) num_clusters * info -> m * sizeof (PROBNODE), WM_TAG_ENGINE);
+  acc.probw2_z = wmallocTag ((size_t) num_clusters * info -> n * sizeof (PROBNODE), WM_TAG_ENGINE);
+  acc.flag_z = wmalloc (num_clusters * sizeof (bool));
+  acc.flag_w1_z = wmallocTag ((size_t) num_clusters * info -> m * sizeof (bool), WM_TAG_ENGINE);
+  acc.flag_w2_z = wmallocTag ((size_t) num_clusters * info -> n * sizeof (bool), WM_TAG_ENGINE);
+  acc.post = wmalloc (num_clusters * sizeof (PROBNODE));
+
+  /*  Normalization compares against the previous probabilities  */
+  initPrevProbs (info);
+
+  info -> iterations = 0;
+  for (info -> iter = 0; ; info -> iter++) {
+    update = (!stop) && (info -> iter < info -> maxiter);
+    curr_ML = streamPass (info, &stream, &acc, update);
+    profileIteration (info, true, curr_ML);
+
+    if (info -> iter == 0) {
+      if (info -> verbose) {
+        fprintf (stderr, "[---]  Initial = %f\n", curr_ML);
+      }
+    }
+    else if (!stop) {
+      diff = (curr_ML - prev_ML) / prev_ML * 100 * -1;
+      if (info -> verbose) {
+        fprintf (stderr, "[%3u]  %f --> %f\t[%f, %2.4f %%]\n", info -> iter, prev_ML, curr_ML, (curr_ML - prev_ML), diff);
+      }
+      /*  Tempered EM does not maximize the log-likelihood, so it may decrease  */
+      if ((curr_ML < prev_ML) && (info -> beta >= 1.0)) {
+        stop = true;
+      }
+      else if ((DBL_LESS (fabs (diff), info -> rtol)) || (fabs (curr_ML - prev_ML) < info -> atol)) {
+        stalls++;
+        if (stalls >= info -> patience) {
+          stop = true;
+        }
+      }
+      else {
+        stalls = 0;
+      }
+    }
+    prev_ML = curr_ML;
+
+    /*  This pass only evaluated the final parameters  */
+    if (!update) {
+      break;
+    }
+    info -> iterations++;
+
+    if ((info -> ptol > 0) && (info -> param_change < info -> ptol)) {
+      if (info -> verbose) {
+        fprintf (stderr, "[%3u]  Largest change in a probability:  %g\n", info -> iter + 1, info -> param_change);
+      }
+      stop = true;
+    }
+  }
+
+  info -> iter = UINT_MAX;
+  info -> final_ML = curr_ML;
+
+  freePrevProbs (info);
+
+  for (b = 0; b < 2; b++) {
+    wfree (stream.blocks[b].row_count);
+    wfree (stream.blocks[b].cells);
+  }
+  pthread_mutex_destroy (&(stream.lock));
+  pthread_cond_destroy (&(stream.cond));
+
+  wfree (acc.probz);
+  wfree (acc.probw1_z);
+  wfree (acc.probw2_z);
+  wfree (acc.flag_z);
+  wfree (acc.flag_w1_z);
+  wfree (acc.flag_w2_z);
+  wfree (acc.post);
+
+  return (curr_ML);
+}
@@ -0,0 +1,204 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+**  Evaluation of a trained model on a separate co-occurrence file:  the
+**  log-likelihood and perplexity of its nonzeros under the model, with
+**  the same k-way sum as calculateML ().
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>                                  /*  UINT_MAX  */
+#include <stdbool.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "wmalloc.h"
+#include "plsa-defn.h"
+#include "input.h"
+#include "evaluate.h"
+
+
+/*!  State shared by the evaluation worker threads  */
+typedef struct eval_work {
+  INFO *info;
+  MODEL *model;
+  unsigned int *row_map;
+  unsigned int *column_map;
+  /*!  Log-likelihood of each row  */
+  PROBNODE *row_ML;
+  /*!  Sum of the counts scored in each row  */
+  double *row_count;
+  /*!  Nonzeros of each row that were skipped because the row or column is not in the model  */
+  unsigned int *row_skipped;
+  /*!  First row of the next batch to be handed out  */
+  unsigned int next_row;
+  pthread_mutex_t lock;
+} EVAL_WORK;
+
+
+/*!  Log-likelihood of row i of the co-occurrence file under the model  */
+static PROBNODE evaluateRow (EVAL_WORK *work, unsigned int i) {
+  MODEL *model = work -> model;
+  COOCCUR *row = work -> info -> cos[i];
+  unsigned int num_clusters = model -> num_clusters;
+  unsigned int cos_count = row[0].column;
+  unsigned int r = work -> row_map[i];
+  unsigned int c;
+  unsigned int k;
+  unsigned int pos_j;
+  PROBNODE temp;
+  PROBNODE total = 0.0;
+
+  work -> row_count[i] = 0.0;
+  work -> row_skipped[i] = 0;
+
+  for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+    c = (r == UINT_MAX) ? UINT_MAX : work -> column_map[row[pos_j].column];
+    if (c == UINT_MAX) {
+      work -> row_skipped[i]++;
+      continue;
+    }
+
+    temp = model -> probz[0] + model -> probw1_z[r] + model -> probw2_z[c];
+    for (k = 1; k < num_clusters; k++) {
+      logSumsInline (temp, model -> probz[k] + model -> probw1_z[(size_t) k * model -> m + r] + model -> probw2_z[(size_t) k * model -> n + c]);
+    }
+
+    total += (temp * DOEXP (row[pos_j].x));
+    work -> row_count[i] += DOEXP (row[pos_j].x);
+  }
+
+  return (total);
+}
+
+
+static void *evaluateWorker (void *arg) {
+  EVAL_WORK *work = (EVAL_WORK*) arg;
+  INFO *info = work -> info;
+  unsigned int start;
+  unsigned int end;
+  unsigned int i;
+
+  while (true) {
+    pthread_mutex_lock (&(work -> lock));
+    start = work -> next_row;
+    work -> next_row += EVAL_BATCH;
+    pthread_mutex_unlock (&(work -> lock));
+
+    if (start >= info -> m) {
+      break;
+    }
+    end = (start + EVAL_BATCH < info -> m) ? start + EVAL_BATCH : info -> m;
+
+    for (i = start; i < end; i++) {
+      work -> row_ML[i] = evaluateRow (work, i);
+    }
+  }
+
+  return (NULL);
+}
+
+
+/*!
+**  Evaluate the model given by --evaluate on the co-occurrence file,
+**  processing batches of rows in parallel.  Rows and columns are matched
+**  to the model by their ids; nonzeros in unknown rows or columns are
+**  skipped.  The result is written to stdout as a header line and a line
+**  of tab-separated values.
+*/
+bool runEvaluate (INFO *info) {
+  EVAL_WORK work;
+  pthread_t *threads = NULL;
+  PROBNODE total_ML = 0.0;
+  double total_count = 0.0;
+  double perplexity = 0.0;
+  unsigned long scored = 0;
+  unsigned long skipped = 0;
+  unsigned int i = 0;
+
+  struct timespec start;
+  struct timespec end;
+
+  GET_TIME (start);
+
+  work.info = info;
+  work.model = readModel (info, info -> eval_model_fn);
+  info -> num_clusters = work.model -> num_clusters;
+  info -> block_size = info -> num_clusters;
+
+  if (!readCO (info)) {
+    fprintf (stderr, "Error reading co-occurrence data.\n");
+    return false;
+  }
+
+  work.row_map = mapIdentifiers (info -> row_ids, info -> m, work.model -> row_ids, work.model -> m);
+  work.column_map = mapIdentifiers (info -> column_ids, info -> n, work.model -> column_ids, work.model -> n);
+
+  work.row_ML = wmalloc (info -> m * sizeof (PROBNODE));
+  work.row_count = wmalloc (info -> m * sizeof (double));
+  work.row_skipped = wmalloc (info -> m * sizeof (unsigned int));
+  work.next_row = 0;
+  pthread_mutex_init (&(work.lock), NULL);
+
+  threads = wmalloc (info -> num_threads * sizeof (pthread_t));
+  for (i = 0; i < info -> num_threads; i++) {
+    pthread_create (&(threads[i]), NULL, evaluateWorker, &work);
+  }
+  for (i = 0; i < info -> num_threads; i++) {
+    pthread_join (threads[i], NULL);
+  }
+  pthread_mutex_destroy (&(work.lock));
+
+  /*  Sum in row order so that the result does not depend on the threads  */
+  for (i = 0; i < info -> m; i++) {
+    total_ML += work.row_ML[i];
+    total_count += work.row_count[i];
+    scored += info -> cos[i][0].column - work.row_skipped[i];
+    skipped += work.row_skipped[i];
+  }
+  perplexity = (total_count > 0.0) ? exp (-total_ML / total_count) : 0.0;
+
+  if (info -> verbose) {
+    fprintf (stderr, "==\tEvaluation nonzeros scored:                     %lu\n", scored);
+    fprintf (stderr, "==\tEvaluation nonzeros skipped:                    %lu\n", skipped);
+    fprintf (stderr, "==\tEvaluation log-likelihood:                      %f\n", total_ML);
+    fprintf (stderr, "==\tEvaluation perplexity:                          %f\n", perplexity);
+  }
+
+  printf ("clusters\tscored\tskipped\tcount\tlog_likelihood\tperplexity\n");
+  printf ("%u\t%lu\t%lu\t%.0f\t%.6f\t%.6f\n", info -> num_clusters, scored, skipped, total_count, total_ML, perplexity);
+
+  wfree (threads);
+  wfree (work.row_ML);
+  wfree (work.row_count);
+  wfree (work.row_skipped);
+  wfree (work.row_map);
+  wfree (work.column_map);
+  freeModel (work.model);
+
+  GET_TIME (end);
+  info -> run_time += ELAPSED_TIME (start, end);
+
+  return (true);
+}
+
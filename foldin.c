@@ -0,0 +1,279 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>                                  /*  UINT_MAX  */
+#include <stdbool.h>
+#include <math.h>
+#include <float.h>  /*  DBL_EPSILON  */
+#include <time.h>
+#include <pthread.h>
+
+#include "wmalloc.h"
+#include "plsa-defn.h"
+#include "input.h"
+#include "foldin.h"
+
+
+/*!  State shared by the fold-in worker threads  */
+typedef struct foldin_work {
+  INFO *info;
+  MODEL *model;
+  unsigned int *column_map;
+  /*!  P(z|w1) of each new row, of size (m * k)  */
+  PROBNODE *probz_w1;
+  /*!  Log-likelihood of each new row  */
+  PROBNODE *row_ML;
+  /*!  First row of the next batch to be handed out  */
+  unsigned int next_row;
+  pthread_mutex_t lock;
+} FOLDIN_WORK;
+
+
+/*!
+**  Fold a single row into a trained model.  P(w2|z) is held fixed and
+**  only P(z|w1) of this row is re-estimated, starting from P(z).  The
+**  row is in the COOCCUR format (position 0 holds the number of values);
+**  column_map translates its columns to those of the model (UINT_MAX if
+**  absent) or is NULL if they are already the same.  scratch must hold
+**  (2 * k) values.  Returns the log-likelihood of the row.
+*/
+PROBNODE foldInRow (MODEL *model, unsigned int maxiter, const COOCCUR *row, const unsigned int *column_map, PROBNODE *probz_w1, PROBNODE *scratch) {
+  unsigned int num_clusters = model -> num_clusters;
+  PROBNODE *acc = scratch;
+  PROBNODE *post = scratch + num_clusters;
+  unsigned int cos_count = row[0].column;
+  unsigned int pos_j;
+  unsigned int iter;
+  unsigned int j;
+  unsigned int k;
+  PROBNODE norm;
+  PROBNODE cos;
+  PROBNODE curr_ML = 0.0;
+  PROBNODE prev_ML = 0.0;
+  bool found;
+
+  for (k = 0; k < num_clusters; k++) {
+    probz_w1[k] = model -> probz[k];
+  }
+
+  for (iter = 0; iter < maxiter; iter++) {
+    curr_ML = 0.0;
+    found = false;
+
+    for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+      j = (column_map == NULL) ? row[pos_j].column : column_map[row[pos_j].column];
+      if (j == UINT_MAX) {
+        continue;
+      }
+      cos = row[pos_j].x;
+
+      /*  E-step:  P(z|w1,w2) for this cell  */
+      for (k = 0; k < num_clusters; k++) {
+        post[k] = probz_w1[k] + model -> probw2_z[(size_t) k * model -> n + j];
+      }
+      norm = post[0];
+      for (k = 1; k < num_clusters; k++) {
+        logSumsInline (norm, post[k]);
+      }
+      curr_ML += norm * DOEXP (cos);
+
+      /*  M-step:  accumulate the counts of each cluster  */
+      for (k = 0; k < num_clusters; k++) {
+        if (found) {
+          logSumsInline (acc[k], cos + post[k] - norm);
+        }
+        else {
+          acc[k] = cos + post[k] - norm;
+        }
+      }
+      found = true;
+    }
+
+    /*  No known columns; the row keeps the prior P(z)  */
+    if (!found) {
+      break;
+    }
+
+    norm = acc[0];
+    for (k = 1; k < num_clusters; k++) {
+      logSumsInline (norm, acc[k]);
+    }
+    for (k = 0; k < num_clusters; k++) {
+      probz_w1[k] = acc[k] - norm;
+    }
+
+    if ((iter != 0) && (DBL_LESS (fabs ((curr_ML - prev_ML) / prev_ML * 100), ML_DELTA))) {
+      break;
+    }
+    prev_ML = curr_ML;
+  }
+
+  return (curr_ML);
+}
+
+
+static void *foldInWorker (void *arg) {
+  FOLDIN_WORK *work = (FOLDIN_WORK*) arg;
+  INFO *info = work -> info;
+  unsigned int num_clusters = work -> model -> num_clusters;
+  PROBNODE *scratch = wmalloc (2 * num_clusters * sizeof (PROBNODE));
+  unsigned int start;
+  unsigned int end;
+  unsigned int i;
+
+  while (true) {
+    pthread_mutex_lock (&(work -> lock));
+    start = work -> next_row;
+    work -> next_row += FOLDIN_BATCH;
+    pthread_mutex_unlock (&(work -> lock));
+
+    if (start >= info -> m) {
+      break;
+    }
+    end = (start + FOLDIN_BATCH < info -> m) ? start + FOLDIN_BATCH : info -> m;
+
+    for (i = start; i < end; i++) {
+      work -> row_ML[i] = foldInRow (work -> model, info -> maxiter, info -> cos[i], work -> column_map, work -> probz_w1 + (size_t) i * num_clusters, scratch);
+    }
+  }
+
+  wfree (scratch);
+
+  return (NULL);
+}
+
+
+/*!
+**  Write P(z|w1) of the folded-in rows.  The format of the file is:
+**
+**  [clusters][rows][row id+][P(z|w1)+]
+**
+**  with the probabilities (as log values) given row by row.
+*/
+static void printFoldIn (INFO *info, FOLDIN_WORK *work) {
+  unsigned int num_clusters = work -> model -> num_clusters;
+  unsigned int i = 0;
+  unsigned int k = 0;
+  FILE *fp = NULL;
+  char *fn = wmalloc (sizeof (char) * (strlen (info -> base_fn) + 10));
+
+  sprintf (fn, "%s.foldin", info -> base_fn);
+  if (info -> textio) {
+    FOPEN (fn, fp, "w");
+    fprintf (fp, "%u\t%u\n", num_clusters, info -> m);
+    for (i = 0; i < info -> m; i++) {
+      fprintf (fp, "%u", info -> row_ids[i]);
+      for (k = 0; k < num_clusters; k++) {
+        fprintf (fp, "\t%lf", work -> probz_w1[(size_t) i * num_clusters + k]);
+      }
+      fprintf (fp, "\n");
+    }
+  }
+  else {
+    FOPEN (fn, fp, "wb");
+    fwrite (&num_clusters, sizeof (unsigned int), 1, fp);
+    fwrite (&info -> m, sizeof (unsigned int), 1, fp);
+    fwrite (info -> row_ids, sizeof (unsigned int), info -> m, fp);
+    fwrite (work -> probz_w1, sizeof (PROBNODE), (size_t) info -> m * num_clusters, fp);
+  }
+
+  FCLOSE (fp);
+  wfree (fn);
+
+  return;
+}
+
+
+/*!
+**  Fold the rows of the co-occurrence file into a trained model,
+**  processing batches of rows in parallel.
+*/
+bool runFoldIn (INFO *info) {
+  FOLDIN_WORK work;
+  pthread_t *threads = NULL;
+  PROBNODE total_ML = 0.0;
+  unsigned int found_columns = 0;
+  unsigned int i = 0;
+  unsigned int j = 0;
+
+  struct timespec start;
+  struct timespec end;
+
+  GET_TIME (start);
+
+  work.info = info;
+  work.model = readModel (info, info -> foldin_model_fn);
+  info -> num_clusters = work.model -> num_clusters;
+  info -> block_size = info -> num_clusters;
+
+  if (!readCO (info)) {
+    fprintf (stderr, "Error reading co-occurrence data.\n");
+    return false;
+  }
+
+  work.column_map = mapIdentifiers (info -> column_ids, info -> n, work.model -> column_ids, work.model -> n);
+  for (j = 0; j < info -> n; j++) {
+    if (work.column_map[j] != UINT_MAX) {
+      found_columns++;
+    }
+  }
+  if (info -> verbose) {
+    fprintf (stderr, "==\tFold-in columns found in model:                 %u of %u\n", found_columns, info -> n);
+  }
+
+  work.probz_w1 = wmalloc ((size_t) info -> m * info -> num_clusters * sizeof (PROBNODE));
+  work.row_ML = wmalloc (info -> m * sizeof (PROBNODE));
+  work.next_row = 0;
+  pthread_mutex_init (&(work.lock), NULL);
+
+  threads = wmalloc (info -> num_threads * sizeof (pthread_t));
+  for (i = 0; i < info -> num_threads; i++) {
+    pthread_create (&(threads[i]), NULL, foldInWorker, &work);
+  }
+  for (i = 0; i < info -> num_threads; i++) {
+    pthread_join (threads[i], NULL);
+  }
+  pthread_mutex_destroy (&(work.lock));
+
+  for (i = 0; i < info -> m; i++) {
+    total_ML += work.row_ML[i];
+  }
+  if (info -> verbose) {
+    fprintf (stderr, "==\tFold-in rows:                                   %u\n", info -> m);
+    fprintf (stderr, "==\tFold-in log-likelihood:                         %f\n", total_ML);
+  }
+
+  if (!info -> no_output) {
+    printFoldIn (info, &work);
+  }
+
+  wfree (threads);
+  wfree (work.probz_w1);
+  wfree (work.row_ML);
+  wfree (work.column_map);
+  freeModel (work.model);
+
+  GET_TIME (end);
+  info -> run_time += ELAPSED_TIME (start, end);
+
+  return (true);
+}
+
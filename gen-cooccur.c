@@ -0,0 +1,356 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*!
+**  Generator of synthetic co-occurrence files for testing and
+**  benchmarking (plsa-gen).  Rows have Zipfian lengths and a planted
+**  topic:  the columns are split at random among the topics, and most
+**  nonzeros of a row fall in the columns of its topic.  The output is in
+**  the format read by readCO (), in binary unless --text is given.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "wmalloc.h"
+
+/*!  Fraction of the nonzeros of a row that fall in the columns of its topic  */
+#define GEN_TOPIC_FRACTION 0.8
+
+/*!  Mean of the co-occurrence counts, which are 1 + geometric  */
+#define GEN_MEAN_COUNT 2.0
+
+/*!  Random draws per nonzero before the rest of a row is filled in order  */
+#define GEN_MAX_DRAWS 20
+
+
+typedef struct gen_settings {
+  unsigned int m;
+  unsigned int n;
+  double density;
+  double skew;
+  unsigned int topics;
+  unsigned int seed;
+  bool textio;
+  char *output_fn;
+} GEN_SETTINGS;
+
+
+static void usage (char *progname) {
+  fprintf (stderr, "Synthetic co-occurrence file generator\n");
+  fprintf (stderr, "======================================\n\n");
+  fprintf (stderr, "Usage:  %s [options]\n\n", progname);
+  fprintf (stderr, "Options:\n");
+  fprintf (stderr, "--output <file>    :  Co-occurrence filename to write.\n");
+  fprintf (stderr, "--rows <int>       :  Number of rows (m).\n");
+  fprintf (stderr, "--columns <int>    :  Number of columns (n).\n");
+  fprintf (stderr, "--density <float>  :  Fraction of the m x n cells that are nonzero.\n");
+  fprintf (stderr, "                   :    (Default:  0.01).\n");
+  fprintf (stderr, "--skew <float>     :  Zipf exponent of the row lengths; 0 for equal lengths.\n");
+  fprintf (stderr, "                   :    (Default:  1.0).\n");
+  fprintf (stderr, "--topics <int>     :  Number of planted topics.  (Default:  10).\n");
+  fprintf (stderr, "--seed <int>       :  Random seed.  (Default:  1).\n");
+  fprintf (stderr, "--text             :  Write in text instead of binary.\n");
+
+  exit (EXIT_SUCCESS);
+}
+
+
+static bool processOptions (int argc, char *argv[], GEN_SETTINGS *settings) {
+  int c = 0;
+  int option_index = 0;
+  static struct option long_options[] = {
+    {"output", 1, 0, 0},
+    {"rows", 1, 0, 0},
+    {"columns", 1, 0, 0},
+    {"density", 1, 0, 0},
+    {"skew", 1, 0, 0},
+    {"topics", 1, 0, 0},
+    {"seed", 1, 0, 0},
+    {"text", 0, 0, 0},
+    {NULL, 0, NULL, 0}
+  };
+
+  settings -> m = 0;
+  settings -> n = 0;
+  settings -> density = 0.01;
+  settings -> skew = 1.0;
+  settings -> topics = 10;
+  settings -> seed = 1;
+  settings -> textio = false;
+  settings -> output_fn = NULL;
+
+  while (true) {
+    c = getopt_long (argc, argv, "", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    if (c != 0) {
+      return false;
+    }
+    if (strcmp (long_options[option_index].name, "output") == 0) {
+      settings -> output_fn = optarg;
+    }
+    else if (strcmp (long_options[option_index].name, "rows") == 0) {
+      settings -> m = atoi (optarg);
+    }
+    else if (strcmp (long_options[option_index].name, "columns") == 0) {
+      settings -> n = atoi (optarg);
+    }
+    else if (strcmp (long_options[option_index].name, "density") == 0) {
+      settings -> density = atof (optarg);
+    }
+    else if (strcmp (long_options[option_index].name, "skew") == 0) {
+      settings -> skew = atof (optarg);
+    }
+    else if (strcmp (long_options[option_index].name, "topics") == 0) {
+      settings -> topics = atoi (optarg);
+    }
+    else if (strcmp (long_options[option_index].name, "seed") == 0) {
+      settings -> seed = atoi (optarg);
+    }
+    else if (strcmp (long_options[option_index].name, "text") == 0) {
+      settings -> textio = true;
+    }
+  }
+
+  if ((settings -> output_fn == NULL) || (settings -> m == 0) || (settings -> n == 0)) {
+    fprintf (stderr, "==\tError:  --output, --rows and --columns are required.\n");
+    return false;
+  }
+  if ((settings -> density <= 0.0) || (settings -> density > 1.0) || (settings -> skew < 0.0)) {
+    fprintf (stderr, "==\tError:  --density must be in (0, 1] and --skew at least 0.\n");
+    return false;
+  }
+  if ((settings -> topics == 0) || (settings -> topics > settings -> n)) {
+    fprintf (stderr, "==\tError:  --topics must be between 1 and the number of columns.\n");
+    return false;
+  }
+
+  return true;
+}
+
+
+/*!  Uniform random number in [0, 1)  */
+static double uniform (unsigned int *state) {
+  return ((double) rand_r (state) / ((double) RAND_MAX + 1.0));
+}
+
+
+static void shuffle (unsigned int *array, unsigned int count, unsigned int *state) {
+  unsigned int i = 0;
+  unsigned int pos = 0;
+  unsigned int temp = 0;
+
+  for (i = count; i > 1; i--) {
+    pos = rand_r (state) % i;
+    temp = array[i - 1];
+    array[i - 1] = array[pos];
+    array[pos] = temp;
+  }
+
+  return;
+}
+
+
+static int compareUnsigned (const void *a, const void *b) {
+  unsigned int x = *((const unsigned int*) a);
+  unsigned int y = *((const unsigned int*) b);
+
+  return ((x > y) - (x < y));
+}
+
+
+static void writeValue (FILE *fp, bool textio, unsigned int value, char sep) {
+  if (textio) {
+    fprintf (fp, "%u%c", value, sep);
+  }
+  else {
+    fwrite (&value, sizeof (unsigned int), 1, fp);
+  }
+
+  return;
+}
+
+
+/*!
+**  Number of nonzeros of each row.  Row lengths are proportional to
+**  1 / rank^skew, with the ranks given to the rows at random, and add up
+**  to about density * m * n; each row has between 1 and n nonzeros.
+*/
+static unsigned int *rowLengths (GEN_SETTINGS *settings, unsigned int *state) {
+  unsigned int m = settings -> m;
+  unsigned int *lengths = wmalloc (m * sizeof (unsigned int));
+  unsigned int *rank = wmalloc (m * sizeof (unsigned int));
+  double total = settings -> density * m * settings -> n;
+  double weight_sum = 0.0;
+  double length = 0.0;
+  unsigned int i = 0;
+
+  for (i = 0; i < m; i++) {
+    rank[i] = i;
+    weight_sum += pow (i + 1, -settings -> skew);
+  }
+  shuffle (rank, m, state);
+
+  for (i = 0; i < m; i++) {
+    length = floor (total * pow (rank[i] + 1, -settings -> skew) / weight_sum + 0.5);
+    if (length < 1.0) {
+      length = 1.0;
+    }
+    if (length > settings -> n) {
+      length = settings -> n;
+    }
+    lengths[i] = (unsigned int) length;
+  }
+  wfree (rank);
+
+  return (lengths);
+}
+
+
+int main (int argc, char *argv[]) {
+  GEN_SETTINGS settings;
+  FILE *fp = NULL;
+  unsigned int state = 0;
+  unsigned int *lengths = NULL;
+  unsigned int *column_topic = NULL;  /*  Topic of each column  */
+  unsigned int *topic_start = NULL;  /*  Columns of topic t are topic_columns[topic_start[t] .. topic_start[t + 1] - 1]  */
+  unsigned int *topic_columns = NULL;
+  unsigned int *marked = NULL;  /*  Row + 1 if the column was already picked for that row  */
+  unsigned int *row = NULL;
+  unsigned int i = 0;
+  unsigned int j = 0;
+  unsigned int t = 0;
+  unsigned int pos = 0;
+  unsigned int draws = 0;
+  unsigned int count = 0;
+  unsigned int freq = 0;
+  unsigned long nonzeros = 0;
+  unsigned long sum_counts = 0;
+
+  if (!processOptions (argc, argv, &settings)) {
+    usage (argv[0]);
+  }
+  state = settings.seed;
+
+  lengths = rowLengths (&settings, &state);
+
+  /*  Split the columns at random into topics of (almost) equal size  */
+  column_topic = wmalloc (settings.n * sizeof (unsigned int));
+  for (j = 0; j < settings.n; j++) {
+    column_topic[j] = j % settings.topics;
+  }
+  shuffle (column_topic, settings.n, &state);
+  topic_start = wmalloc ((settings.topics + 1) * sizeof (unsigned int));
+  for (t = 0; t <= settings.topics; t++) {
+    topic_start[t] = 0;
+  }
+  for (j = 0; j < settings.n; j++) {
+    topic_start[column_topic[j] + 1]++;
+  }
+  for (t = 0; t < settings.topics; t++) {
+    topic_start[t + 1] += topic_start[t];
+  }
+  topic_columns = wmalloc (settings.n * sizeof (unsigned int));
+  marked = wmalloc (settings.n * sizeof (unsigned int));
+  for (j = 0; j < settings.n; j++) {
+    marked[j] = topic_start[column_topic[j]]++;
+  }
+  for (j = 0; j < settings.n; j++) {
+    topic_columns[marked[j]] = j;
+    marked[j] = 0;
+  }
+  for (t = settings.topics; t > 0; t--) {
+    topic_start[t] = topic_start[t - 1];
+  }
+  topic_start[0] = 0;
+
+  fp = fopen (settings.output_fn, settings.textio ? "w" : "wb");
+  if (fp == NULL) {
+    fprintf (stderr, "Error creating %s.\n", settings.output_fn);
+    exit (EXIT_FAILURE);
+  }
+
+  writeValue (fp, settings.textio, settings.m, '\t');
+  writeValue (fp, settings.textio, settings.n, '\n');
+  for (i = 0; i < settings.m; i++) {
+    writeValue (fp, settings.textio, i, (i == settings.m - 1) ? '\n' : '\t');
+  }
+  for (j = 0; j < settings.n; j++) {
+    writeValue (fp, settings.textio, j, (j == settings.n - 1) ? '\n' : '\t');
+  }
+
+  row = wmalloc (settings.n * sizeof (unsigned int));
+  for (i = 0; i < settings.m; i++) {
+    t = rand_r (&state) % settings.topics;
+
+    /*  Draw distinct columns, mostly from the topic of the row  */
+    count = 0;
+    for (draws = 0; (count < lengths[i]) && (draws < GEN_MAX_DRAWS * lengths[i]); draws++) {
+      if (uniform (&state) < GEN_TOPIC_FRACTION) {
+        pos = topic_start[t] + rand_r (&state) % (topic_start[t + 1] - topic_start[t]);
+        j = topic_columns[pos];
+      }
+      else {
+        j = rand_r (&state) % settings.n;
+      }
+      if (marked[j] != i + 1) {
+        marked[j] = i + 1;
+        row[count++] = j;
+      }
+    }
+    /*  Very long rows:  take the remaining columns in order  */
+    for (j = 0; (count < lengths[i]) && (j < settings.n); j++) {
+      if (marked[j] != i + 1) {
+        marked[j] = i + 1;
+        row[count++] = j;
+      }
+    }
+    qsort (row, count, sizeof (unsigned int), compareUnsigned);
+
+    writeValue (fp, settings.textio, i, '\t');
+    writeValue (fp, settings.textio, count, (count == 0) ? '\n' : '\t');
+    for (pos = 0; pos < count; pos++) {
+      /*  Counts are 1 + geometric with mean GEN_MEAN_COUNT  */
+      freq = 1 + (unsigned int) floor (log (1.0 - uniform (&state)) / log (1.0 - 1.0 / GEN_MEAN_COUNT));
+      writeValue (fp, settings.textio, row[pos], '\t');
+      writeValue (fp, settings.textio, freq, (pos == count - 1) ? '\n' : '\t');
+      sum_counts += freq;
+    }
+    nonzeros += count;
+  }
+  fclose (fp);
+
+  fprintf (stderr, "==\tRows x columns:                                 %u x %u\n", settings.m, settings.n);
+  fprintf (stderr, "==\tNonzeros:                                       %lu (%.4f %%)\n", nonzeros, (double) nonzeros / ((double) settings.m * settings.n) * 100);
+  fprintf (stderr, "==\tSum of co-occurrence counts:                    %lu\n", sum_counts);
+
+  wfree (row);
+  wfree (marked);
+  wfree (topic_columns);
+  wfree (topic_start);
+  wfree (column_topic);
+  wfree (lengths);
+
+  return (EXIT_SUCCESS);
+}
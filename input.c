@@ -28,34 +28,41 @@
 #include "wmalloc.h"
 #include "plsa-defn.h"
 #include "debug.h"
+#include "dedup.h"
+#include "reorder.h"
 #include "input.h"
 
 
 /*!  Initialization that depends on the input file or parameters  */
 void initializePostInput (INFO *info) {
   unsigned int i = 0;
-  unsigned int size = 0;
   unsigned int temp = 0;
 
-  info -> cos = wmalloc (info -> m * sizeof (COOCCUR*));
-
-  /*  All processes read the co-occurrence data, so all must initialize  */
-  /*  Cannot allocate more space since we don't know the number of values in each row  */
-  for (i = 0; i < info -> m; i++) {
-    info -> cos[i] = NULL;
+  /*  In streaming mode, the co-occurrence data is never held in memory  */
+  if (info -> stream) {
+    info -> cos = NULL;
   }
+  else {
+    info -> cos = wmallocTag (info -> m * sizeof (COOCCUR*), WM_TAG_COOCCUR);
 
-  size = info -> num_clusters;
+    /*  All processes read the co-occurrence data, so all must initialize  */
+    /*  Cannot allocate more space since we don't know the number of values in each row  */
+    for (i = 0; i < info -> m; i++) {
+      info -> cos[i] = NULL;
+    }
+  }
 
-  /*  Allocate space  */
-  info -> probw1_z = wmalloc (size * info -> m * sizeof (PROBNODE));
-  info -> probw2_z = wmalloc (size * info -> n * sizeof (PROBNODE));
-  info -> probz = wmalloc (size * sizeof (PROBNODE));
-  info -> probz_w1w2 = wmalloc (size * sizeof (PROBNODE*));
-  for (i = 0; i < size; i++) {
-    info -> probz_w1w2[i] = wmalloc (info -> m * info -> n * sizeof (PROBNODE));
+  info -> heldout = NULL;
+  if (info -> holdout > 0.0) {
+    info -> heldout = wmallocTag (info -> m * sizeof (COOCCUR*), WM_TAG_COOCCUR);
+    for (i = 0; i < info -> m; i++) {
+      info -> heldout[i] = NULL;
+    }
   }
 
+  /*  Probabilities are allocated separately by allocateProbs () since
+  **  not every mode of the program needs all of them  */
+
   /*  Set seed if given as an argument, otherwise use the time  */
   if (info -> seed == UINT_MAX) {
     temp = time (NULL);
@@ -64,7 +71,89 @@ void initializePostInput (INFO *info) {
       fprintf (stderr, "==\tApplying seed from time:                        %u\n", temp);
     }
   }
-  srand (info -> seed);
+
+  return;
+}
+
+
+/*!
+**  Move a random fraction (info -> holdout) of the nonzeros of row i to
+**  the held-out rows.  The first nonzero of each row is always kept so
+**  that no row is left without training data.  Returns the number of
+**  nonzeros held out.
+*/
+static unsigned int splitRow (INFO *info, unsigned int i, unsigned int *state) {
+  unsigned int cos_count = GET_COS_POSITION (i, 0);
+  unsigned int kept = (cos_count > 0) ? 1 : 0;
+  unsigned int held = 0;
+  COOCCUR *row = NULL;
+
+  row = wmallocTag (sizeof (COOCCUR) * (cos_count + 1), WM_TAG_COOCCUR);
+  for (unsigned int j = 2; j <= cos_count; j++) {
+    if ((double) rand_r (state) / ((double) RAND_MAX + 1.0) < info -> holdout) {
+      held++;
+      row[held] = info -> cos[i][j];
+    }
+    else {
+      kept++;
+      info -> cos[i][kept] = info -> cos[i][j];
+    }
+  }
+
+  row[0].x = 0.0;
+  row[0].column = held;
+  info -> cos[i][0].column = kept;
+  info -> heldout[i] = row;
+
+  return (held);
+}
+
+
+/*!
+**  Build the column-major index of (info -> cos).  The nonzeros of each
+**  column are listed by increasing row, so visiting them gives the same
+**  order of summation as a pass over the rows.
+*/
+static void buildColumnIndex (INFO *info) {
+  COLINDEX *colindex = wmalloc (sizeof (COLINDEX));
+  size_t *next = NULL;
+  size_t nonzeros = 0;
+  unsigned int cos_count = 0;
+  unsigned int i = 0;
+  unsigned int j = 0;
+  unsigned int pos_j = 0;
+
+  colindex -> start = wmallocTag ((info -> n + 1) * sizeof (size_t), WM_TAG_INDEX);
+  for (j = 0; j <= info -> n; j++) {
+    colindex -> start[j] = 0;
+  }
+  for (i = 0; i < info -> m; i++) {
+    cos_count = GET_COS_POSITION (i, 0);
+    for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+      colindex -> start[GET_COS_POSITION (i, pos_j) + 1]++;
+    }
+    nonzeros += cos_count;
+  }
+  for (j = 0; j < info -> n; j++) {
+    colindex -> start[j + 1] += colindex -> start[j];
+  }
+
+  colindex -> row = wmallocTag ((nonzeros + 1) * sizeof (unsigned int), WM_TAG_INDEX);
+  colindex -> pos = wmallocTag ((nonzeros + 1) * sizeof (unsigned int), WM_TAG_INDEX);
+  next = wmalloc ((info -> n + 1) * sizeof (size_t));
+  memcpy (next, colindex -> start, info -> n * sizeof (size_t));
+  for (i = 0; i < info -> m; i++) {
+    cos_count = GET_COS_POSITION (i, 0);
+    for (pos_j = 1; pos_j <= cos_count; pos_j++) {
+      j = GET_COS_POSITION (i, pos_j);
+      colindex -> row[next[j]] = i;
+      colindex -> pos[next[j]] = pos_j;
+      next[j]++;
+    }
+  }
+  wfree (next);
+
+  info -> colindex = colindex;
 
   return;
 }
@@ -94,15 +183,17 @@ bool readCO (INFO *info) {
   unsigned int rows = 0;
   unsigned int cols = 0;
   unsigned int cos_count = 0;
-  unsigned int found_pairs = 0;
+  unsigned long found_pairs = 0;
   unsigned int found_w1 = 0;
 
-  unsigned int sum_freq = 0;
-  unsigned int nonzero_count = 0;
-  time_t start;
-  time_t end;
+  unsigned long sum_freq = 0;
+  unsigned long nonzero_count = 0;
+  unsigned long heldout_count = 0;
+  unsigned int state = 0;
+  struct timespec start;
+  struct timespec end;
 
-  time (&start);
+  GET_TIME (start);
 
   PROGRESS_MSG ("Reading from co-occurrence file...");
 
@@ -123,8 +214,8 @@ bool readCO (INFO *info) {
 
   initializePostInput (info);
 
-  info -> row_ids = wmalloc (info -> m * sizeof (unsigned int));
-  info -> column_ids = wmalloc (info -> n * sizeof (unsigned int));
+  info -> row_ids = wmallocTag (info -> m * sizeof (unsigned int), WM_TAG_INDEX);
+  info -> column_ids = wmallocTag (info -> n * sizeof (unsigned int), WM_TAG_INDEX);
 
   if (info -> textio) {
     for (unsigned int i = 0; i < info -> m; i++) {
@@ -139,6 +230,20 @@ bool readCO (INFO *info) {
     fread (info -> column_ids, sizeof (unsigned int), info -> n, fp);
   }
 
+  /*  The rows are read on each iteration by the streaming E/M step  */
+  if (info -> stream) {
+    info -> data_offset = ftell (fp);
+    FCLOSE (fp);
+
+    GET_TIME (end);
+    info -> readCO_time += ELAPSED_TIME (start, end);
+
+    return (true);
+  }
+
+  /*  The split depends only on the seed, not on how the model is initialized  */
+  state = info -> seed;
+
   found_pairs = 0;
   found_w1 = 0;
   for (unsigned int i = 0; i < info -> m; i++) {
@@ -161,7 +266,7 @@ bool readCO (INFO *info) {
     }
 
     /*  Allocate space for the row  */
-    info -> cos[i] = wmalloc (sizeof (COOCCUR) * (cos_count + 1));
+    info -> cos[i] = wmallocTag (sizeof (COOCCUR) * (cos_count + 1), WM_TAG_COOCCUR);
 
     /*  Position 0 of each row is cos_count    */
     info ->  cos[i][0].x = 0.0;
@@ -182,7 +287,7 @@ bool readCO (INFO *info) {
         nonzero_count++;
       }
 
-      if (w2 > info -> n) {
+      if (w2 >= info -> n) {
         fprintf (stderr, "Word 2 (%u) is out of range (%u).\n", w2, info -> n);
         exit (EXIT_FAILURE);
       }
@@ -197,6 +302,10 @@ bool readCO (INFO *info) {
 
       found_pairs++;
     }
+
+    if (info -> heldout != NULL) {
+      heldout_count += splitRow (info, i, &state);
+    }
   }
   FCLOSE (fp);
 
@@ -207,21 +316,255 @@ bool readCO (INFO *info) {
   }
 
   if (info -> verbose) {
-    unsigned int zero_count = (info -> m * info -> n) - nonzero_count;
-    fprintf (stderr, "==\tMaximum number of pairs:                        %u\n", info -> m * info -> n);
-    fprintf (stderr, "==\tActual number of pairs in data file:            %u\n", found_pairs);
-    fprintf (stderr, "==\tPercentage of zeroes:                           %.2f %% (%u)\n", (double) zero_count / (double) ((info -> m * info -> n)) * 100, zero_count);
-    fprintf (stderr, "==\tSum of co-occurrence counts:                    %u\n", sum_freq);
+    unsigned long max_pairs = (unsigned long) info -> m * info -> n;
+    unsigned long zero_count = max_pairs - nonzero_count;
+    fprintf (stderr, "==\tMaximum number of pairs:                        %lu\n", max_pairs);
+    fprintf (stderr, "==\tActual number of pairs in data file:            %lu\n", found_pairs);
+    fprintf (stderr, "==\tPercentage of zeroes:                           %.2f %% (%lu)\n", (double) zero_count / (double) max_pairs * 100, zero_count);
+    fprintf (stderr, "==\tSum of co-occurrence counts:                    %lu\n", sum_freq);
+    if (info -> heldout != NULL) {
+      fprintf (stderr, "==\tPairs held out:                                 %lu\n", heldout_count);
+    }
   }
 
 #if DEBUG
     debugCheckCo (info);
 #endif
 
-  time (&end);
-  info -> readCO_time += difftime (end, start);
+  if (info -> deduplicate) {
+    dedupCO (info);
+  }
+
+  if (info -> reorder_mode != REORDER_NONE) {
+    reorderCO (info);
+  }
+
+  if (info -> mstep_threads > 1) {
+    buildColumnIndex (info);
+  }
+
+  info -> num_nonzeros = 0;
+  for (unsigned int i = 0; i < info -> m; i++) {
+    info -> num_nonzeros += GET_COS_POSITION (i, 0);
+  }
+
+  GET_TIME (end);
+  info -> readCO_time += ELAPSED_TIME (start, end);
 
   return (true);
 }
 
 
+/*!
+**  Read a model file previously written by printModel ().  The format
+**  of the file is:
+**
+**  [clusters][rows][columns][row id+][column id+][P(z)+][P(w1|z)+][P(w2|z)+]
+**
+**  All probabilities are log values; P(w1|z) and P(w2|z) are stored
+**  cluster-by-cluster, as in memory.  As with the co-occurrence file,
+**  values are in binary unless textmode is TRUE.
+*/
+/*!  Report a model file that cannot be read and exit  */
+static void badModel (char *fn, const char *problem) {
+  fprintf (stderr, "Model file %s %s.\n", fn, problem);
+  exit (EXIT_FAILURE);
+}
+
+
+MODEL *readModel (INFO *info, char *fn) {
+  FILE *fp = NULL;
+  MODEL *model = wmalloc (sizeof (MODEL));
+  unsigned int i = 0;
+  size_t p = 0;
+  unsigned int header[3];
+  long file_size = 0;
+  double num_values = 0.0;  /*  Values the header calls for, including itself  */
+
+  if (info -> textio) {
+    FOPEN (fn, fp, "r");
+  }
+  else {
+    FOPEN (fn, fp, "rb");
+  }
+  fseek (fp, 0, SEEK_END);
+  file_size = ftell (fp);
+  rewind (fp);
+
+  if (info -> textio) {
+    if ((fscanf (fp, "%u", &(header[0])) != 1) || (fscanf (fp, "%u", &(header[1])) != 1) || (fscanf (fp, "%u", &(header[2])) != 1)) {
+      badModel (fn, "has no header in text; if it is binary, leave out --text");
+    }
+  }
+  else {
+    if (fread (header, sizeof (unsigned int), 3, fp) != 3) {
+      badModel (fn, "is too short to have a header");
+    }
+  }
+  model -> num_clusters = header[0];
+  model -> m = header[1];
+  model -> n = header[2];
+  if ((model -> num_clusters == 0) || (model -> m == 0) || (model -> n == 0)) {
+    badModel (fn, "has no clusters, rows or columns");
+  }
+
+  /*  Check the size of the file against the header before allocating for it  */
+  num_values = 3.0 + model -> m + model -> n;
+  num_values += (double) model -> num_clusters * (1.0 + model -> m + model -> n);
+  if (info -> textio) {
+    /*  Each value takes at least one digit and one separator  */
+    if (2.0 * num_values - 1.0 > (double) file_size) {
+      badModel (fn, "is too short for its header; if it is binary, leave out --text");
+    }
+  }
+  else {
+    if ((double) sizeof (unsigned int) * (3.0 + model -> m + model -> n) + (double) sizeof (PROBNODE) * (num_values - 3.0 - model -> m - model -> n) != (double) file_size) {
+      badModel (fn, "does not have the size its header calls for; if it is text, add --text");
+    }
+  }
+
+  model -> row_ids = wmalloc (model -> m * sizeof (unsigned int));
+  model -> column_ids = wmalloc (model -> n * sizeof (unsigned int));
+  model -> probz = wmallocTag (model -> num_clusters * sizeof (PROBNODE), WM_TAG_MODEL);
+  model -> probw1_z = wmallocTag ((size_t) model -> num_clusters * model -> m * sizeof (PROBNODE), WM_TAG_MODEL);
+  model -> probw2_z = wmallocTag ((size_t) model -> num_clusters * model -> n * sizeof (PROBNODE), WM_TAG_MODEL);
+
+  if (info -> textio) {
+    for (i = 0; i < model -> m; i++) {
+      if (fscanf (fp, "%u", &(model -> row_ids[i])) != 1) {
+        badModel (fn, "has a missing or malformed row id");
+      }
+    }
+    for (i = 0; i < model -> n; i++) {
+      if (fscanf (fp, "%u", &(model -> column_ids[i])) != 1) {
+        badModel (fn, "has a missing or malformed column id");
+      }
+    }
+    for (i = 0; i < model -> num_clusters; i++) {
+      if (fscanf (fp, "%lf", &(model -> probz[i])) != 1) {
+        badModel (fn, "has a missing or malformed value of P(z)");
+      }
+    }
+    for (p = 0; p < (size_t) model -> num_clusters * model -> m; p++) {
+      if (fscanf (fp, "%lf", &(model -> probw1_z[p])) != 1) {
+        badModel (fn, "has a missing or malformed value of P(w1|z)");
+      }
+    }
+    for (p = 0; p < (size_t) model -> num_clusters * model -> n; p++) {
+      if (fscanf (fp, "%lf", &(model -> probw2_z[p])) != 1) {
+        badModel (fn, "has a missing or malformed value of P(w2|z)");
+      }
+    }
+  }
+  else {
+    if ((fread (model -> row_ids, sizeof (unsigned int), model -> m, fp) != model -> m) ||
+        (fread (model -> column_ids, sizeof (unsigned int), model -> n, fp) != model -> n) ||
+        (fread (model -> probz, sizeof (PROBNODE), model -> num_clusters, fp) != model -> num_clusters) ||
+        (fread (model -> probw1_z, sizeof (PROBNODE), (size_t) model -> num_clusters * model -> m, fp) != (size_t) model -> num_clusters * model -> m) ||
+        (fread (model -> probw2_z, sizeof (PROBNODE), (size_t) model -> num_clusters * model -> n, fp) != (size_t) model -> num_clusters * model -> n)) {
+      badModel (fn, "is truncated");
+    }
+  }
+  FCLOSE (fp);
+
+  if (info -> verbose) {
+    fprintf (stderr, "==\tModel read from %s:  k = %u; m = %u; n = %u\n", fn, model -> num_clusters, model -> m, model -> n);
+  }
+
+  return (model);
+}
+
+
+void freeColumnIndex (COLINDEX *colindex) {
+  wfree (colindex -> start);
+  wfree (colindex -> row);
+  wfree (colindex -> pos);
+  wfree (colindex);
+
+  return;
+}
+
+
+void freeModel (MODEL *model) {
+  wfree (model -> row_ids);
+  wfree (model -> column_ids);
+  wfree (model -> probz);
+  wfree (model -> probw1_z);
+  wfree (model -> probw2_z);
+  wfree (model);
+
+  return;
+}
+
+
+static int compareIdPos (const void *a, const void *b) {
+  const IDPOS *x = (const IDPOS*) a;
+  const IDPOS *y = (const IDPOS*) b;
+
+  if (x -> id < y -> id) {
+    return -1;
+  }
+  else if (x -> id > y -> id) {
+    return 1;
+  }
+  return 0;
+}
+
+
+/*!  Build an index for looking up the position of each of the (count) identifiers  */
+IDINDEX *createIdIndex (const unsigned int *ids, unsigned int count) {
+  IDINDEX *index = wmalloc (sizeof (IDINDEX));
+  unsigned int i = 0;
+
+  index -> count = count;
+  index -> sorted = wmallocTag ((count + 1) * sizeof (IDPOS), WM_TAG_INDEX);
+  for (i = 0; i < count; i++) {
+    index -> sorted[i].id = ids[i];
+    index -> sorted[i].pos = i;
+  }
+  qsort (index -> sorted, count, sizeof (IDPOS), compareIdPos);
+
+  return (index);
+}
+
+
+/*!  Position of an identifier, or UINT_MAX if it is not in the index  */
+unsigned int findIdentifier (const IDINDEX *index, unsigned int id) {
+  IDPOS key;
+  IDPOS *found = NULL;
+
+  key.id = id;
+  found = bsearch (&key, index -> sorted, index -> count, sizeof (IDPOS), compareIdPos);
+
+  return ((found == NULL) ? UINT_MAX : found -> pos);
+}
+
+
+void freeIdIndex (IDINDEX *index) {
+  wfree (index -> sorted);
+  wfree (index);
+
+  return;
+}
+
+
+/*!
+**  Map each of the (count) identifiers in ids to its position in
+**  prior_ids.  The returned array has count entries; identifiers that
+**  do not appear in prior_ids are mapped to UINT_MAX.  The caller frees
+**  the array with wfree ().
+*/
+unsigned int *mapIdentifiers (const unsigned int *ids, unsigned int count, const unsigned int *prior_ids, unsigned int prior_count) {
+  unsigned int *map = wmalloc (count * sizeof (unsigned int));
+  IDINDEX *index = createIdIndex (prior_ids, prior_count);
+  unsigned int i = 0;
+
+  for (i = 0; i < count; i++) {
+    map[i] = findIdentifier (index, ids[i]);
+  }
+
+  freeIdIndex (index);
+
+  return (map);
+}
+
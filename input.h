@@ -21,5 +21,12 @@
 
 void initializePostInput (INFO *info);
 bool readCO (INFO *info);
+void freeColumnIndex (COLINDEX *colindex);
+MODEL *readModel (INFO *info, char *fn);
+void freeModel (MODEL *model);
+IDINDEX *createIdIndex (const unsigned int *ids, unsigned int count);
+unsigned int findIdentifier (const IDINDEX *index, unsigned int id);
+void freeIdIndex (IDINDEX *index);
+unsigned int *mapIdentifiers (const unsigned int *ids, unsigned int count, const unsigned int *prior_ids, unsigned int prior_count);
 
 #endif
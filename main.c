@@ -25,6 +25,9 @@
 #include "plsa-defn.h"
 #include "wmalloc.h"
 #include "parameters.h"
+#include "foldin.h"
+#include "evaluate.h"
+#include "server.h"
 #include "run.h"
 
 
@@ -40,6 +43,15 @@ int main (int argc, char *argv[]) {
   if ((!processOptions (argc, argv, info)) || (!checkSettings (info))) {
     usage (argv[0]);
   }
+  else if (info -> socket_fn != NULL) {
+    result = runServer (info);
+  }
+  else if (info -> eval_model_fn != NULL) {
+    result = runEvaluate (info);
+  }
+  else if (info -> foldin_model_fn != NULL) {
+    result = runFoldIn (info);
+  }
   else {
     result = run (info);
   }
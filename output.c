@@ -27,6 +27,7 @@
 
 #include "wmalloc.h"
 #include "plsa-defn.h"
+#include "perf.h"
 #include "output.h"
 
 
@@ -37,15 +38,16 @@ void printCoProb (INFO *info) {
   unsigned int k = 0;  /*  Index into clusters  */
   PROBNODE temp;
   PROBNODE tempsum = 0.0;
-  unsigned int nonprob = 0;
+  unsigned long nonprob = 0;
   FILE *fp = NULL;
   char *fn = wmalloc (sizeof (char) * (strlen (info -> base_fn) + 10));
   static unsigned int snapshot_count = 0;
 
-  time_t start;
-  time_t end;
+  struct timespec start;
+  struct timespec end;
 
-  time (&start);
+  GET_TIME (start);
+  PERF_START (perf_fds);
   snapshot_count++;
 
   sprintf (fn, "%s.plsa", info -> base_fn);
@@ -99,15 +101,167 @@ void printCoProb (INFO *info) {
   wfree (fn);
 
   if ((info -> verbose) && (info -> iter == UINT_MAX)) {
-    fprintf (stderr, "==\tNon-probabilities:                              %u\n", nonprob);
+    fprintf (stderr, "==\tNon-probabilities:                              %lu\n", nonprob);
     fprintf (stderr, "==\tSum of p(x,y):                                  %f\n", tempsum);
     fprintf (stderr, "==\tTotal output files printed                      %u\n", snapshot_count);
   }
 
-  time (&end);
-  info -> printCoProbs_time += difftime (end, start);
+  PERF_STOP (perf_fds, info -> printCoProbs_perf);
+  GET_TIME (end);
+  info -> printCoProbs_time += ELAPSED_TIME (start, end);
 
   return;
 }
 
 
+/*!  Write the trained factors to a model file; see readModel () for the format  */
+void printModel (INFO *info) {
+  unsigned int i = 0;
+  size_t p = 0;
+  FILE *fp = NULL;
+  char *fn = wmalloc (sizeof (char) * (strlen (info -> base_fn) + 10));
+
+  struct timespec start;
+  struct timespec end;
+
+  GET_TIME (start);
+  PERF_START (perf_fds);
+
+  sprintf (fn, "%s.model", info -> base_fn);
+  if (info -> textio) {
+    FOPEN (fn, fp, "w");
+    fprintf (fp, "%u\t", info -> num_clusters);
+    fprintf (fp, "%u\t", info -> m);
+    fprintf (fp, "%u\n", info -> n);
+    for (i = 0; i < info -> m; i++) {
+      fprintf (fp, "%u\t", info -> row_ids[i]);
+    }
+    fprintf (fp, "\n");
+    for (i = 0; i < info -> n; i++) {
+      fprintf (fp, "%u\t", info -> column_ids[i]);
+    }
+    fprintf (fp, "\n");
+    /*  Full precision so that the model can be read back without loss  */
+    for (i = 0; i < info -> num_clusters; i++) {
+      fprintf (fp, "%.17g\t", GET_PROBZ (i));
+    }
+    fprintf (fp, "\n");
+    for (p = 0; p < (size_t) info -> num_clusters * info -> m; p++) {
+      fprintf (fp, "%.17g\t", info -> probw1_z[p]);
+    }
+    fprintf (fp, "\n");
+    for (p = 0; p < (size_t) info -> num_clusters * info -> n; p++) {
+      fprintf (fp, "%.17g\t", info -> probw2_z[p]);
+    }
+    fprintf (fp, "\n");
+  }
+  else {
+    FOPEN (fn, fp, "wb");
+    fwrite (&info -> num_clusters, sizeof (unsigned int), 1, fp);
+    fwrite (&info -> m, sizeof (unsigned int), 1, fp);
+    fwrite (&info -> n, sizeof (unsigned int), 1, fp);
+    fwrite (info -> row_ids, sizeof (unsigned int), info -> m, fp);
+    fwrite (info -> column_ids, sizeof (unsigned int), info -> n, fp);
+    fwrite (info -> probz, sizeof (PROBNODE), info -> num_clusters, fp);
+    fwrite (info -> probw1_z, sizeof (PROBNODE), (size_t) info -> num_clusters * info -> m, fp);
+    fwrite (info -> probw2_z, sizeof (PROBNODE), (size_t) info -> num_clusters * info -> n, fp);
+  }
+
+  FCLOSE (fp);
+  wfree (fn);
+
+  PERF_STOP (perf_fds, info -> printCoProbs_perf);
+  GET_TIME (end);
+  info -> printCoProbs_time += ELAPSED_TIME (start, end);
+
+  return;
+}
+
+/*!
+**  Write the statistics of each model trained from a different seed, one
+**  per line, as [clusters][restart][seed][iterations][log-likelihood]
+**  [seconds], with the model that was kept for each number of clusters
+**  marked by a "*".
+*/
+void printRestarts (INFO *info, RESTART *restarts) {
+  unsigned int job = 0;
+  unsigned int c = 0;
+  unsigned int r = 0;
+  unsigned int best = 0;
+  FILE *fp = NULL;
+  char *fn = wmalloc (sizeof (char) * (strlen (info -> base_fn) + 10));
+
+  sprintf (fn, "%s.restarts", info -> base_fn);
+  FOPEN (fn, fp, "w");
+  for (c = 0; c < info -> num_cluster_list; c++) {
+    /*  Ties go to the earliest restart, as when training  */
+    best = c * info -> num_restarts;
+    for (r = 1; r < info -> num_restarts; r++) {
+      if (restarts[c * info -> num_restarts + r].ML > restarts[best].ML) {
+        best = c * info -> num_restarts + r;
+      }
+    }
+
+    for (r = 0; r < info -> num_restarts; r++) {
+      job = c * info -> num_restarts + r;
+      fprintf (fp, "%u\t%u\t%u\t%u\t%f\t%.3f%s\n", restarts[job].num_clusters, r, restarts[job].seed, restarts[job].iterations, restarts[job].ML, restarts[job].time, (job == best) ? "\t*" : "");
+      if (info -> verbose) {
+        fprintf (stderr, "==\tk = %u, restart %3u (seed %u):  %u iterations, ML = %f%s\n", restarts[job].num_clusters, r, restarts[job].seed, restarts[job].iterations, restarts[job].ML, (job == best) ? "  [best]" : "");
+      }
+    }
+  }
+  FCLOSE (fp);
+  wfree (fn);
+
+  return;
+}
+
+
+/*!
+**  Write one line per number of clusters of a sweep, as [clusters]
+**  [seed][iterations][log-likelihood] of the model that was kept.
+*/
+void printSweep (INFO *info, INFO **models) {
+  unsigned int c = 0;
+  FILE *fp = NULL;
+  char *fn = wmalloc (sizeof (char) * (strlen (info -> base_fn) + 10));
+
+  sprintf (fn, "%s.sweep", info -> base_fn);
+  FOPEN (fn, fp, "w");
+  for (c = 0; c < info -> num_cluster_list; c++) {
+    fprintf (fp, "%u\t%u\t%u\t%f\n", models[c] -> initial_clusters, models[c] -> seed, models[c] -> iterations, models[c] -> final_ML);
+    if (info -> verbose) {
+      fprintf (stderr, "==\tk = %4u:  %u iterations, ML = %f\n", models[c] -> initial_clusters, models[c] -> iterations, models[c] -> final_ML);
+    }
+  }
+  FCLOSE (fp);
+  wfree (fn);
+
+  return;
+}
+
+
+/*!
+**  Write the clusters removed by --prune, one per line, as [cluster]
+**  [iteration][P(z)].  The remaining clusters keep their order in the
+**  model file.
+*/
+void printPruned (INFO *info) {
+  unsigned int p = 0;
+  FILE *fp = NULL;
+  char *fn = wmalloc (sizeof (char) * (strlen (info -> base_fn) + 10));
+
+  sprintf (fn, "%s.pruned", info -> base_fn);
+  FOPEN (fn, fp, "w");
+  for (p = 0; p < info -> num_pruned; p++) {
+    fprintf (fp, "%u\t%u\t%g\n", info -> pruned[p].cluster, info -> pruned[p].iteration, DOEXP (info -> pruned[p].probz));
+  }
+  FCLOSE (fp);
+  wfree (fn);
+
+  if (info -> verbose) {
+    fprintf (stderr, "==\tClusters pruned:                                %u of %u\n", info -> num_pruned, info -> initial_clusters);
+  }
+
+  return;
+}
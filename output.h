@@ -20,5 +20,9 @@
 #define OUTPUT_H
 
 void printCoProb (INFO *info);
+void printModel (INFO *info);
+void printRestarts (INFO *info, RESTART *restarts);
+void printSweep (INFO *info, INFO **models);
+void printPruned (INFO *info);
 
 #endif
@@ -37,15 +37,65 @@ void usage (char *progname) {
   fprintf (stderr, "Options:\n");
   fprintf (stderr, "--base <file>      :  Base filename for output file.\n");
   fprintf (stderr, "--cooccur <file>   :  Co-occurrence filename.\n");
-  fprintf (stderr, "--clusters <int>   :  Number of clusters.\n");
+  fprintf (stderr, "--clusters <int>   :  Number of clusters.  A comma-separated list\n");
+  fprintf (stderr, "                   :    (e.g., 8,16,32) trains a model for each.\n");
   fprintf (stderr, "--seed <int>       :  Random seed.\n");
   fprintf (stderr, "                   :    (Default:  current time).\n");
   fprintf (stderr, "--maxiter <int>    :  Maximum iterations.\n");
+  fprintf (stderr, "--rtol <float>     :  Stop when the log-likelihood changes by less than this\n");
+  fprintf (stderr, "                   :    percentage.  (Default:  %f).\n", ML_DELTA);
+  fprintf (stderr, "--atol <float>     :  Stop when the log-likelihood changes by less than this.\n");
+  fprintf (stderr, "--ptol <float>     :  Stop when no probability changes by more than this.\n");
+  fprintf (stderr, "--patience <int>   :  Number of consecutive evaluations that must meet --rtol\n");
+  fprintf (stderr, "                   :    or --atol.  (Default:  1).\n");
+  fprintf (stderr, "--ml-every <int>   :  Calculate the log-likelihood every this many iterations.\n");
+  fprintf (stderr, "                   :    (Default:  1).\n");
+  fprintf (stderr, "--beta <float>     :  Tempered EM with this inverse temperature.  (Default:  1.0).\n");
+  fprintf (stderr, "--holdout <float>  :  Hold out this fraction of the nonzeros and stop when\n");
+  fprintf (stderr, "                   :    their log-likelihood stops improving.\n");
+  fprintf (stderr, "--beta-decay <float>: Multiply beta by this when the held-out log-likelihood\n");
+  fprintf (stderr, "                   :    stops improving.  (Default:  %.1f).\n", TEM_BETA_DECAY);
+  fprintf (stderr, "--sparse <int>     :  Keep only the likely clusters of each nonzero, refreshing\n");
+  fprintf (stderr, "                   :    them every this many iterations.\n");
+  fprintf (stderr, "--sparse-cutoff <float>:  Drop clusters with log posterior below -this.\n");
+  fprintf (stderr, "                   :    (Default:  %f).\n", LN_LIMIT);
+  fprintf (stderr, "--prune <float>    :  Remove clusters whose P(z) stays below this.\n");
+  fprintf (stderr, "--dedup            :  Merge identical rows and columns before training.\n");
+  fprintf (stderr, "--reorder <order>  :  Reorder rows and columns for locality (frequency or rcm).\n");
+  fprintf (stderr, "--restarts <int>   :  Train this many models from seeds (seed + 0, seed + 1, ...)\n");
+  fprintf (stderr, "                   :    and keep the best.  (Default:  1).\n");
+  fprintf (stderr, "--accelerate       :  Accelerate EM by extrapolation (SQUAREM).\n");
+  fprintf (stderr, "--minibatch <int>  :  Online EM, updating after each batch of this many rows.\n");
+  fprintf (stderr, "--max-batches <int>:  Stop online EM after this many batches, even within\n");
+  fprintf (stderr, "                   :    an epoch.  (Default:  0, no limit).\n");
+  fprintf (stderr, "--stream           :  Read the co-occurrence file on each iteration instead\n");
+  fprintf (stderr, "                   :    of keeping it in memory.\n");
+  fprintf (stderr, "--kappa <float>    :  Online EM step size is (batches + tau)^-kappa.\n");
+  fprintf (stderr, "                   :    (Default:  %.1f).\n", ONLINE_KAPPA);
+  fprintf (stderr, "--tau <float>      :  (Default:  %.1f).\n", ONLINE_TAU);
   fprintf (stderr, "--text             :  Text mode (I/O is in text, not binary).\n");
   fprintf (stderr, "--verbose          :  Verbose mode.\n");
   fprintf (stderr, "--debug            :  Debugging output.\n");
+  fprintf (stderr, "--profile <file>   :  Write the time of each phase and iteration as JSON\n");
+  fprintf (stderr, "                   :    (CSV if the filename ends in .csv).\n");
   fprintf (stderr, "--rounding         :  Round using %u as the multiplication factor.\n", ROUND_DIGITS);
   fprintf (stderr, "--nooutput         :  Suppress outputting p(x,y) to file.\n");
+  fprintf (stderr, "                   :    (The small <base>.model file is still written).\n");
+  fprintf (stderr, "--init-model <file>:  Warm-start from a previously trained model.\n");
+  fprintf (stderr, "--init <method>    :  Start P(w2|z) from random values or from rows of the\n");
+  fprintf (stderr, "                   :    data (random, sample or kmeans++).  (Default:  random).\n");
+  fprintf (stderr, "--foldin <file>    :  Fold the rows of the co-occurrence file into this model.\n");
+  fprintf (stderr, "                   :    (Default iterations:  %u).\n", FOLDIN_MAXITER);
+  fprintf (stderr, "--evaluate <file>  :  Print the log-likelihood and perplexity of the\n");
+  fprintf (stderr, "                   :    co-occurrence file under this model.\n");
+  fprintf (stderr, "--serve <socket>   :  Serve requests for --model on a Unix domain socket.\n");
+  fprintf (stderr, "--model <file>     :  Model to load with --serve.\n");
+  fprintf (stderr, "--threads <int>    :  Number of worker threads.\n");
+  fprintf (stderr, "                   :    (Default:  1).\n");
+  fprintf (stderr, "--hugepages <type> :  Back the large arrays with huge pages\n");
+  fprintf (stderr, "                   :    (transparent or explicit).\n");
+  fprintf (stderr, "--numa <policy>    :  Place the large arrays over NUMA nodes\n");
+  fprintf (stderr, "                   :    (interleave or local).\n");
 
   fprintf (stderr, "\nPLSA version:  %s (%s)\n\n", __DATE__, __TIME__);
 
@@ -54,26 +104,189 @@ void usage (char *progname) {
 
 
 bool checkSettings (INFO *info) {
+  /*  The server needs only a model and the number of fold-in iterations  */
+  if (info -> socket_fn != NULL) {
+    if (info -> model_fn == NULL) {
+      fprintf (stderr, "==\tError:  Model filename required with the --model option.\n");
+      return false;
+    }
+    if (info -> maxiter == 0) {
+      info -> maxiter = FOLDIN_MAXITER;
+    }
+    if (info -> num_threads == 0) {
+      fprintf (stderr, "==\tError:  At least one thread required with the --threads option.\n");
+      return false;
+    }
+    return true;
+  }
+
   if (info -> co_fn == NULL) {
     fprintf (stderr, "==\tError:  Co-occurrence filename required with the --cooccur option.\n");
     return false;
   }
 
+  /*  Evaluation needs only a model and the co-occurrence file  */
+  if (info -> eval_model_fn != NULL) {
+    if ((info -> stream) || (info -> holdout > 0.0) || (info -> deduplicate)) {
+      fprintf (stderr, "==\tError:  --evaluate cannot be used with --stream, --holdout or --dedup.\n");
+      return false;
+    }
+    if (info -> num_threads == 0) {
+      fprintf (stderr, "==\tError:  At least one thread required with the --threads option.\n");
+      return false;
+    }
+    return true;
+  }
+
+  /*  Fold-in takes the number of clusters from the model  */
+  if (info -> foldin_model_fn != NULL) {
+    if (info -> maxiter == 0) {
+      info -> maxiter = FOLDIN_MAXITER;
+    }
+  }
+
   if (info -> maxiter == 0) {
     fprintf (stderr, "==\tError:  Maximum number of iterations required with the --maxiter option.\n");
     return false;
   }
 
-  if (info -> num_clusters == 0) {
+  for (unsigned int c = 0; c < info -> num_cluster_list; c++) {
+    if (info -> cluster_list[c] == 0) {
+      info -> num_clusters = 0;
+    }
+  }
+  if ((info -> num_clusters == 0) && (info -> foldin_model_fn == NULL)) {
     fprintf (stderr, "==\tError:  Number of clusters required with the --clusters option.\n");
     return false;
   }
 
+  /*  Each value of a sweep writes its own files, so it can only appear once  */
+  for (unsigned int c = 1; c < info -> num_cluster_list; c++) {
+    for (unsigned int d = 0; d < c; d++) {
+      if (info -> cluster_list[c] == info -> cluster_list[d]) {
+        fprintf (stderr, "==\tError:  %u is given more than once with --clusters.\n", info -> cluster_list[c]);
+        return false;
+      }
+    }
+  }
+
+  if ((info -> init_model_fn != NULL) && (info -> num_cluster_list > 1)) {
+    fprintf (stderr, "==\tError:  --init-model needs a single number of clusters, matching the model.\n");
+    return false;
+  }
+
   if (info -> base_fn == NULL) {
     fprintf (stderr, "==\tError:  Base filename required with the --base option.\n");
     return false;
   }
 
+  if (info -> num_threads == 0) {
+    fprintf (stderr, "==\tError:  At least one thread required with the --threads option.\n");
+    return false;
+  }
+
+  if ((info -> minibatch != 0) && ((info -> online_kappa <= 0.5) || (info -> online_kappa > 1.0) || (info -> online_tau < 1.0))) {
+    fprintf (stderr, "==\tError:  --kappa must be in (0.5, 1] and --tau at least 1.\n");
+    return false;
+  }
+
+  if ((info -> beta <= 0.0) || (info -> beta > 1.0) || (info -> beta_decay <= 0.0) || (info -> beta_decay > 1.0)) {
+    fprintf (stderr, "==\tError:  --beta and --beta-decay must be in (0, 1].\n");
+    return false;
+  }
+
+  if ((info -> holdout < 0.0) || (info -> holdout >= 1.0)) {
+    fprintf (stderr, "==\tError:  --holdout must be in [0, 1).\n");
+    return false;
+  }
+
+  if ((info -> holdout > 0.0) && ((info -> stream) || (info -> minibatch != 0) || (info -> foldin_model_fn != NULL))) {
+    fprintf (stderr, "==\tError:  --holdout cannot be used with --stream, --minibatch or --foldin.\n");
+    return false;
+  }
+
+  if ((info -> sparse_refresh != 0) && ((info -> stream) || (info -> minibatch != 0) || (info -> accelerate))) {
+    fprintf (stderr, "==\tError:  --sparse cannot be used with --stream, --minibatch or --accelerate.\n");
+    return false;
+  }
+
+  if ((info -> init_mode != INIT_RANDOM) && (info -> stream)) {
+    fprintf (stderr, "==\tError:  --init sample or kmeans++ cannot be used with --stream.\n");
+    return false;
+  }
+
+  if ((info -> reorder_mode != REORDER_NONE) && (info -> stream)) {
+    fprintf (stderr, "==\tError:  --reorder cannot be used with --stream.\n");
+    return false;
+  }
+
+  if ((info -> deduplicate) && ((info -> stream) || (info -> holdout > 0.0) || (info -> foldin_model_fn != NULL))) {
+    fprintf (stderr, "==\tError:  --dedup cannot be used with --stream, --holdout or --foldin.\n");
+    return false;
+  }
+
+  if ((info -> prune_threshold < 0.0) || (info -> prune_threshold >= 1.0)) {
+    fprintf (stderr, "==\tError:  --prune must be in [0, 1).\n");
+    return false;
+  }
+
+  if ((info -> prune_threshold > 0.0) && ((info -> stream) || (info -> minibatch != 0) || (info -> accelerate) || (info -> holdout > 0.0))) {
+    fprintf (stderr, "==\tError:  --prune cannot be used with --stream, --minibatch, --accelerate or --holdout.\n");
+    return false;
+  }
+
+  if (info -> sparse_cutoff <= 0.0) {
+    fprintf (stderr, "==\tError:  --sparse-cutoff must be positive.\n");
+    return false;
+  }
+
+  if ((info -> max_batches != 0) && (info -> minibatch == 0)) {
+    fprintf (stderr, "==\tError:  --max-batches requires --minibatch.\n");
+    return false;
+  }
+
+  if ((info -> stream) && ((info -> minibatch != 0) || (info -> accelerate))) {
+    fprintf (stderr, "==\tError:  --stream cannot be used with --minibatch or --accelerate.\n");
+    return false;
+  }
+
+  if ((info -> stream) && (info -> foldin_model_fn != NULL)) {
+    fprintf (stderr, "==\tError:  --stream cannot be used with --foldin.\n");
+    return false;
+  }
+
+  if ((info -> minibatch != 0) && (info -> accelerate)) {
+    fprintf (stderr, "==\tError:  --accelerate cannot be used with --minibatch.\n");
+    return false;
+  }
+
+  if ((info -> patience == 0) || (info -> ml_every == 0)) {
+    fprintf (stderr, "==\tError:  --patience and --ml-every must be at least 1.\n");
+    return false;
+  }
+
+  if (info -> num_restarts == 0) {
+    fprintf (stderr, "==\tError:  At least one restart required with the --restarts option.\n");
+    return false;
+  }
+
+  /*  Threads beyond one per model are shared by the M-step of each model  */
+  if ((info -> foldin_model_fn == NULL) && (info -> minibatch == 0) && (!info -> stream) && (info -> sparse_refresh == 0)) {
+    unsigned int num_jobs = info -> num_cluster_list * info -> num_restarts;
+
+    if (info -> num_threads > num_jobs) {
+      info -> mstep_threads = info -> num_threads / num_jobs;
+    }
+  }
+
+  if ((info -> numa == NUMA_LOCAL) && (info -> mstep_threads == 1)) {
+    fprintf (stderr, "==\tError:  --numa local needs more threads than models, for a parallel M-step.\n");
+    return false;
+  }
+
+  /*  Large blocks allocated from here on get the pages asked for  */
+  configureWMalloc (info -> hugepages, info -> numa == NUMA_INTERLEAVE);
+
   if (info -> verbose) {
     fprintf (stderr, "Settings\n");
     fprintf (stderr, "--------\n");
@@ -89,7 +302,16 @@ bool checkSettings (INFO *info) {
     else {
       fprintf (stderr, "Unknown!\n");
     }
-    fprintf (stderr, "==\tClusters:                                       %u\n", info -> num_clusters);
+    if (info -> num_cluster_list == 0) {
+      fprintf (stderr, "==\tClusters:                                       [from model]\n");
+    }
+    else {
+      fprintf (stderr, "==\tClusters:                                       %u", info -> cluster_list[0]);
+      for (unsigned int c = 1; c < info -> num_cluster_list; c++) {
+        fprintf (stderr, ",%u", info -> cluster_list[c]);
+      }
+      fprintf (stderr, "\n");
+    }
     if (info -> seed != UINT_MAX) {
       fprintf (stderr, "==\tRandom seed:                                    %u\n", info -> seed);
     }
@@ -99,13 +321,63 @@ bool checkSettings (INFO *info) {
     fprintf (stderr, "==\tExponent difference [utils.h::addLogsFloat]:    %.8f\n", LN_LIMIT);
     fprintf (stderr, "==\tTermination conditions\n");
     fprintf (stderr, "==\t  Maximum EM iterations:                        %u\n", info -> maxiter);
-    fprintf (stderr, "==\t  Percentage difference:                        %f\n", ML_DELTA);
+    fprintf (stderr, "==\t  Percentage difference:                        %f\n", info -> rtol);
+    if (info -> atol > 0) {
+      fprintf (stderr, "==\t  Absolute difference:                          %f\n", info -> atol);
+    }
+    if (info -> ptol > 0) {
+      fprintf (stderr, "==\t  Largest change in a probability:              %g\n", info -> ptol);
+    }
+    fprintf (stderr, "==\t  Patience:                                     %u\n", info -> patience);
+    fprintf (stderr, "==\t  Log-likelihood every:                         %u iterations\n", info -> ml_every);
+    fprintf (stderr, "==\tTempered EM beta:                               %f\n", info -> beta);
+    if (info -> holdout > 0.0) {
+      fprintf (stderr, "==\t  Held-out fraction:                            %f\n", info -> holdout);
+      fprintf (stderr, "==\t  Beta decay:                                   %f\n", info -> beta_decay);
+    }
+    fprintf (stderr, "==\tAccelerated EM (SQUAREM):                       %s\n", (info -> accelerate) ? "yes" : "no");
+    fprintf (stderr, "==\tMerge duplicate rows and columns:               %s\n", (info -> deduplicate) ? "yes" : "no");
+    fprintf (stderr, "==\tReorder rows and columns:                       %s\n", (info -> reorder_mode == REORDER_RCM) ? "rcm" : ((info -> reorder_mode == REORDER_FREQUENCY) ? "frequency" : "no"));
+    fprintf (stderr, "==\tInitialization:                                 %s\n", (info -> init_mode == INIT_KMEANSPP) ? "kmeans++" : ((info -> init_mode == INIT_SAMPLE) ? "sample" : "random"));
+    if (info -> prune_threshold > 0.0) {
+      fprintf (stderr, "==\tPrune clusters with P(z) below:                 %g (for %u iterations)\n", info -> prune_threshold, PRUNE_PATIENCE);
+    }
+    if (info -> sparse_refresh != 0) {
+      fprintf (stderr, "==\tSparse posteriors refreshed every:              %u iterations\n", info -> sparse_refresh);
+      fprintf (stderr, "==\tSparse posterior cutoff (log):                  %f\n", info -> sparse_cutoff);
+    }
+    fprintf (stderr, "==\tStreaming EM:                                   %s\n", (info -> stream) ? "yes" : "no");
+    if (info -> minibatch != 0) {
+      fprintf (stderr, "==\tOnline EM rows per batch:                       %u\n", info -> minibatch);
+      if (info -> max_batches != 0) {
+        fprintf (stderr, "==\tOnline EM maximum batches:                      %u\n", info -> max_batches);
+      }
+      fprintf (stderr, "==\tOnline EM step size:                            (t + %.2f)^-%.2f\n", info -> online_tau, info -> online_kappa);
+    }
+    if (info -> num_restarts > 1) {
+      fprintf (stderr, "==\tRandom restarts:                                %u\n", info -> num_restarts);
+    }
     fprintf (stderr, "==\tText mode:                                      %s\n", (info -> textio) ? "yes" : "no");
     fprintf (stderr, "==\tRounding:                                       %s\n", (info -> rounding) ? "yes" : "no");
     if (info -> rounding) {
       fprintf (stderr, "==\tRounding factor:                                %u\n", ROUND_DIGITS);
     }
     fprintf (stderr, "==\tSuppress output to file:                        %s\n", (info -> no_output) ? "yes" : "no");
+    if (info -> init_model_fn != NULL) {
+      fprintf (stderr, "==\tWarm-start model filename:                      %s\n", info -> init_model_fn);
+    }
+    if (info -> foldin_model_fn != NULL) {
+      fprintf (stderr, "==\tFold-in model filename:                         %s\n", info -> foldin_model_fn);
+    }
+    fprintf (stderr, "==\tThreads:                                        %u\n", info -> num_threads);
+    if (info -> profile_fn != NULL) {
+      fprintf (stderr, "==\tProfile filename:                               %s\n", info -> profile_fn);
+    }
+    if (info -> mstep_threads > 1) {
+      fprintf (stderr, "==\tM-step threads per model:                       %u\n", info -> mstep_threads);
+    }
+    fprintf (stderr, "==\tHuge pages:                                     %s\n", (info -> hugepages == WM_PAGES_EXPLICIT) ? "explicit" : ((info -> hugepages == WM_PAGES_TRANSPARENT) ? "transparent" : "no"));
+    fprintf (stderr, "==\tNUMA placement:                                 %s\n", (info -> numa == NUMA_LOCAL) ? "local" : ((info -> numa == NUMA_INTERLEAVE) ? "interleave" : "default"));
 
     fprintf (stderr, "\n\n");
   }
@@ -119,14 +391,47 @@ bool processOptions (int argc, char *argv[], INFO *info) {
 
   char *base_fn = NULL;
   char *co_fn = NULL;
+  char *init_model_fn = NULL;
+  char *foldin_model_fn = NULL;
+  char *eval_model_fn = NULL;
+  char *socket_fn = NULL;
+  char *profile_fn = NULL;
+  char *model_fn = NULL;
+  unsigned int num_threads = 1;
   unsigned int num_clusters = 0;
+  unsigned int *cluster_list = NULL;
+  unsigned int num_cluster_list = 0;
+  char *token = NULL;
   unsigned int seed = UINT_MAX;
   unsigned int maxiter = 0;
+  unsigned int num_restarts = 1;
+  PROBNODE rtol = ML_DELTA;
+  PROBNODE atol = 0.0;
+  PROBNODE ptol = 0.0;
+  unsigned int patience = 1;
+  unsigned int ml_every = 1;
+  PROBNODE beta = 1.0;
+  PROBNODE beta_decay = TEM_BETA_DECAY;
+  PROBNODE holdout = 0.0;
+  unsigned int sparse_refresh = 0;
+  bool deduplicate = false;
+  unsigned int reorder_mode = REORDER_NONE;
+  unsigned int init_mode = INIT_RANDOM;
+  unsigned int hugepages = WM_PAGES_DEFAULT;
+  unsigned int numa = NUMA_DEFAULT;
+  PROBNODE prune_threshold = 0.0;
+  PROBNODE sparse_cutoff = LN_LIMIT;
   bool verbose = false;
   bool debug = false;
   bool textio = false;
   bool rounding = false;
   bool no_output = false;
+  bool accelerate = false;
+  unsigned int minibatch = 0;
+  unsigned int max_batches = 0;
+  bool stream = false;
+  PROBNODE online_kappa = ONLINE_KAPPA;
+  PROBNODE online_tau = ONLINE_TAU;
 
   /*  Usage information if no arguments  */
   if (argc == 1) {
@@ -141,11 +446,41 @@ bool processOptions (int argc, char *argv[], INFO *info) {
       {"clusters", 1, 0, 0},
       {"seed", 1, 0, 0},
       {"maxiter", 1, 0, 0},
+      {"restarts", 1, 0, 0},
+      {"rtol", 1, 0, 0},
+      {"beta", 1, 0, 0},
+      {"beta-decay", 1, 0, 0},
+      {"holdout", 1, 0, 0},
+      {"sparse", 1, 0, 0},
+      {"prune", 1, 0, 0},
+      {"dedup", 0, 0, 0},
+      {"reorder", 1, 0, 0},
+      {"init", 1, 0, 0},
+      {"sparse-cutoff", 1, 0, 0},
+      {"atol", 1, 0, 0},
+      {"ptol", 1, 0, 0},
+      {"patience", 1, 0, 0},
+      {"ml-every", 1, 0, 0},
       {"verbose", 0, 0, 0},
       {"debug", 0, 0, 0},
       {"text", 0, 0, 0},
       {"rounding", 0, 0, 0},
       {"nooutput", 0, 0, 0},
+      {"accelerate", 0, 0, 0},
+      {"minibatch", 1, 0, 0},
+      {"max-batches", 1, 0, 0},
+      {"stream", 0, 0, 0},
+      {"kappa", 1, 0, 0},
+      {"tau", 1, 0, 0},
+      {"init-model", 1, 0, 0},
+      {"foldin", 1, 0, 0},
+      {"evaluate", 1, 0, 0},
+      {"threads", 1, 0, 0},
+      {"serve", 1, 0, 0},
+      {"profile", 1, 0, 0},
+      {"model", 1, 0, 0},
+      {"hugepages", 1, 0, 0},
+      {"numa", 1, 0, 0},
       {0, 0, 0, 0}
     };
 
@@ -161,7 +496,14 @@ bool processOptions (int argc, char *argv[], INFO *info) {
           co_fn = strcpy (co_fn, optarg);
         }
         else if (strcmp (long_options[option_index].name, "clusters") == 0) {
-          num_clusters = atoi (optarg);
+          /*  Either a single value or a comma-separated list  */
+          wfree (cluster_list);
+          cluster_list = wmalloc ((strlen (optarg) / 2 + 1) * sizeof (unsigned int));
+          num_cluster_list = 0;
+          for (token = strtok (optarg, ","); token != NULL; token = strtok (NULL, ",")) {
+            cluster_list[num_cluster_list++] = atoi (token);
+          }
+          num_clusters = (num_cluster_list > 0) ? cluster_list[0] : 0;
         }
         else if (strcmp (long_options[option_index].name, "seed") == 0) {
           seed = atoi (optarg);
@@ -173,6 +515,72 @@ bool processOptions (int argc, char *argv[], INFO *info) {
         else if (strcmp (long_options[option_index].name, "maxiter") == 0) {
           maxiter = atoi (optarg);
         }
+        else if (strcmp (long_options[option_index].name, "rtol") == 0) {
+          rtol = atof (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "atol") == 0) {
+          atol = atof (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "beta") == 0) {
+          beta = atof (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "beta-decay") == 0) {
+          beta_decay = atof (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "holdout") == 0) {
+          holdout = atof (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "reorder") == 0) {
+          if (strcmp (optarg, "frequency") == 0) {
+            reorder_mode = REORDER_FREQUENCY;
+          }
+          else if (strcmp (optarg, "rcm") == 0) {
+            reorder_mode = REORDER_RCM;
+          }
+          else {
+            fprintf (stderr, "==\tError:  Unknown ordering for --reorder:  %s\n", optarg);
+            return false;
+          }
+        }
+        else if (strcmp (long_options[option_index].name, "init") == 0) {
+          if (strcmp (optarg, "random") == 0) {
+            init_mode = INIT_RANDOM;
+          }
+          else if (strcmp (optarg, "sample") == 0) {
+            init_mode = INIT_SAMPLE;
+          }
+          else if (strcmp (optarg, "kmeans++") == 0) {
+            init_mode = INIT_KMEANSPP;
+          }
+          else {
+            fprintf (stderr, "==\tError:  Unknown method for --init:  %s\n", optarg);
+            return false;
+          }
+        }
+        else if (strcmp (long_options[option_index].name, "dedup") == 0) {
+          deduplicate = true;
+        }
+        else if (strcmp (long_options[option_index].name, "prune") == 0) {
+          prune_threshold = atof (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "sparse") == 0) {
+          sparse_refresh = atoi (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "sparse-cutoff") == 0) {
+          sparse_cutoff = atof (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "ptol") == 0) {
+          ptol = atof (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "patience") == 0) {
+          patience = atoi (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "ml-every") == 0) {
+          ml_every = atoi (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "restarts") == 0) {
+          num_restarts = atoi (optarg);
+        }
         else if (strcmp (long_options[option_index].name, "verbose") == 0) {
           verbose = true;
         }
@@ -188,6 +596,75 @@ bool processOptions (int argc, char *argv[], INFO *info) {
         else if (strcmp (long_options[option_index].name, "nooutput") == 0) {
           no_output = true;
         }
+        else if (strcmp (long_options[option_index].name, "accelerate") == 0) {
+          accelerate = true;
+        }
+        else if (strcmp (long_options[option_index].name, "stream") == 0) {
+          stream = true;
+        }
+        else if (strcmp (long_options[option_index].name, "minibatch") == 0) {
+          minibatch = atoi (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "max-batches") == 0) {
+          max_batches = atoi (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "kappa") == 0) {
+          online_kappa = atof (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "tau") == 0) {
+          online_tau = atof (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "init-model") == 0) {
+          init_model_fn = wmalloc (strlen (optarg) + 1);
+          init_model_fn = strcpy (init_model_fn, optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "foldin") == 0) {
+          foldin_model_fn = wmalloc (strlen (optarg) + 1);
+          foldin_model_fn = strcpy (foldin_model_fn, optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "evaluate") == 0) {
+          eval_model_fn = wmalloc (strlen (optarg) + 1);
+          eval_model_fn = strcpy (eval_model_fn, optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "profile") == 0) {
+          profile_fn = wmalloc (strlen (optarg) + 1);
+          profile_fn = strcpy (profile_fn, optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "serve") == 0) {
+          socket_fn = wmalloc (strlen (optarg) + 1);
+          socket_fn = strcpy (socket_fn, optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "model") == 0) {
+          model_fn = wmalloc (strlen (optarg) + 1);
+          model_fn = strcpy (model_fn, optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "threads") == 0) {
+          num_threads = atoi (optarg);
+        }
+        else if (strcmp (long_options[option_index].name, "hugepages") == 0) {
+          if (strcmp (optarg, "transparent") == 0) {
+            hugepages = WM_PAGES_TRANSPARENT;
+          }
+          else if (strcmp (optarg, "explicit") == 0) {
+            hugepages = WM_PAGES_EXPLICIT;
+          }
+          else {
+            fprintf (stderr, "==\tError:  Unknown page type for --hugepages:  %s\n", optarg);
+            return false;
+          }
+        }
+        else if (strcmp (long_options[option_index].name, "numa") == 0) {
+          if (strcmp (optarg, "interleave") == 0) {
+            numa = NUMA_INTERLEAVE;
+          }
+          else if (strcmp (optarg, "local") == 0) {
+            numa = NUMA_LOCAL;
+          }
+          else {
+            fprintf (stderr, "==\tError:  Unknown policy for --numa:  %s\n", optarg);
+            return false;
+          }
+        }
         break;
       default:
         printf ("?? getopt returned character code 0%o ??\n", c);
@@ -197,14 +674,46 @@ bool processOptions (int argc, char *argv[], INFO *info) {
 
   info -> base_fn = base_fn;
   info -> co_fn = co_fn;
+  info -> init_model_fn = init_model_fn;
+  info -> foldin_model_fn = foldin_model_fn;
+  info -> eval_model_fn = eval_model_fn;
+  info -> socket_fn = socket_fn;
+  info -> profile_fn = profile_fn;
+  info -> model_fn = model_fn;
+  info -> num_threads = num_threads;
+  info -> hugepages = hugepages;
+  info -> numa = numa;
   info -> num_clusters = num_clusters;
+  info -> cluster_list = cluster_list;
+  info -> num_cluster_list = num_cluster_list;
   info -> seed = seed;
   info -> maxiter = maxiter;
+  info -> num_restarts = num_restarts;
+  info -> rtol = rtol;
+  info -> atol = atol;
+  info -> ptol = ptol;
+  info -> patience = patience;
+  info -> ml_every = ml_every;
+  info -> beta = beta;
+  info -> beta_decay = beta_decay;
+  info -> holdout = holdout;
+  info -> sparse_refresh = sparse_refresh;
+  info -> prune_threshold = prune_threshold;
+  info -> deduplicate = deduplicate;
+  info -> reorder_mode = reorder_mode;
+  info -> init_mode = init_mode;
+  info -> sparse_cutoff = sparse_cutoff;
   info -> verbose = verbose;
   info -> debug = debug;
   info -> textio = textio;
   info -> rounding = rounding;
   info -> no_output = no_output;
+  info -> accelerate = accelerate;
+  info -> minibatch = minibatch;
+  info -> max_batches = max_batches;
+  info -> stream = stream;
+  info -> online_kappa = online_kappa;
+  info -> online_tau = online_tau;
 
   /*  Set the range of clusters this process will handle; without MPI, it is obviously all clusters  */
   info -> block_size = info -> num_clusters;
@@ -0,0 +1,214 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*!
+**  Hardware performance counters for the EM phases.  In builds with
+**  PERF_COUNTERS, each phase opens Linux perf_event_open () counters for
+**  the calling thread (and the threads it starts) and adds their values
+**  to its PERF_COUNTS in INFO when it ends.  A counter that cannot be
+**  opened, for example because of /proc/sys/kernel/perf_event_paranoid,
+**  is skipped and reported as unavailable.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#if PERF_COUNTERS
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "plsa-defn.h"
+#include "perf.h"
+
+
+void clearCounts (PERF_COUNTS *counts) {
+  unsigned int e = 0;
+
+  for (e = 0; e < PERF_NUM_EVENTS; e++) {
+    counts -> value[e] = 0;
+    counts -> valid[e] = false;
+  }
+
+  return;
+}
+
+
+void addCounts (PERF_COUNTS *total, const PERF_COUNTS *counts) {
+  unsigned int e = 0;
+
+  for (e = 0; e < PERF_NUM_EVENTS; e++) {
+    total -> value[e] += counts -> value[e];
+    total -> valid[e] = (total -> valid[e]) || (counts -> valid[e]);
+  }
+
+  return;
+}
+
+
+#if PERF_COUNTERS
+
+/*!  perf_event_open () configuration of each counter, in PERF_* order  */
+static const unsigned long long perf_config[PERF_NUM_EVENTS] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_REFERENCES,
+  PERF_COUNT_HW_CACHE_MISSES
+};
+
+
+void startCounters (int *fds) {
+  struct perf_event_attr attr;
+  unsigned int e = 0;
+
+  for (e = 0; e < PERF_NUM_EVENTS; e++) {
+    memset (&attr, 0, sizeof (struct perf_event_attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof (struct perf_event_attr);
+    attr.config = perf_config[e];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fds[e] = syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  return;
+}
+
+
+/*!  Counters multiplexed with others are scaled up to the whole phase  */
+void stopCounters (int *fds, PERF_COUNTS *counts) {
+  unsigned long long data[3];  /*  Value, time enabled, time running  */
+  unsigned int e = 0;
+
+  for (e = 0; e < PERF_NUM_EVENTS; e++) {
+    if (fds[e] < 0) {
+      continue;
+    }
+    if ((read (fds[e], data, sizeof (data)) == sizeof (data)) && (data[2] > 0)) {
+      counts -> value[e] += (unsigned long long) ((double) data[0] * data[1] / data[2]);
+      counts -> valid[e] = true;
+    }
+    close (fds[e]);
+  }
+
+  return;
+}
+
+
+/*!  Print a counter, or "n/a" if it could not be opened  */
+static void printCount (const PERF_COUNTS *counts, unsigned int e) {
+  if (counts -> valid[e]) {
+    fprintf (stderr, "  %14llu", counts -> value[e]);
+  }
+  else {
+    fprintf (stderr, "  %14s", "n/a");
+  }
+
+  return;
+}
+
+
+static void printPhase (const char *name, const PERF_COUNTS *counts, double seconds, long line_size) {
+  fprintf (stderr, "==\t    %-24s", name);
+  printCount (counts, PERF_CYCLES);
+  printCount (counts, PERF_INSTRUCTIONS);
+  printCount (counts, PERF_CACHE_MISSES);
+  if ((counts -> valid[PERF_CYCLES]) && (counts -> valid[PERF_INSTRUCTIONS]) && (counts -> value[PERF_CYCLES] > 0)) {
+    fprintf (stderr, "  %6.2f", (double) counts -> value[PERF_INSTRUCTIONS] / counts -> value[PERF_CYCLES]);
+  }
+  else {
+    fprintf (stderr, "  %6s", "n/a");
+  }
+  if ((counts -> valid[PERF_CACHE_REFERENCES]) && (counts -> valid[PERF_CACHE_MISSES]) && (counts -> value[PERF_CACHE_REFERENCES] > 0)) {
+    fprintf (stderr, "  %6.2f %%", (double) counts -> value[PERF_CACHE_MISSES] / counts -> value[PERF_CACHE_REFERENCES] * 100);
+  }
+  else {
+    fprintf (stderr, "  %8s", "n/a");
+  }
+  if ((counts -> valid[PERF_CACHE_MISSES]) && (seconds > 0)) {
+    fprintf (stderr, "  %8.3f GB/s", (double) counts -> value[PERF_CACHE_MISSES] * line_size / seconds / 1e9);
+  }
+  else {
+    fprintf (stderr, "  %13s", "n/a");
+  }
+  fprintf (stderr, "\n");
+
+  return;
+}
+
+
+/*!  Counters of each phase; the bandwidth is cache misses times the line size  */
+void printCounters (INFO *info) {
+  long line_size = sysconf (_SC_LEVEL1_DCACHE_LINESIZE);
+
+  if (line_size <= 0) {
+    line_size = 64;
+  }
+
+  fprintf (stderr, "==\t  Hardware counters:        %14s  %14s  %14s  %6s  %8s  %13s\n", "cycles", "instructions", "cache misses", "IPC", "miss rate", "bandwidth");
+  printPhase ("Calculate ML:", &(info -> calculateML_perf), info -> calculateML_time, line_size);
+  printPhase ("Apply E step:", &(info -> applyEStep_perf), info -> applyEStep_time, line_size);
+  printPhase ("Apply M step:", &(info -> applyMStep_perf), info -> applyMStep_time, line_size);
+  printPhase ("Normalize probabilities:", &(info -> normalizeProbs_perf), info -> normalizeProbs_time, line_size);
+  printPhase ("Print probabilities:", &(info -> printCoProbs_perf), info -> printCoProbs_time, line_size);
+
+  return;
+}
+
+
+static void printPhaseJSON (FILE *fp, const char *name, const PERF_COUNTS *counts, bool last) {
+  static const char *event_names[PERF_NUM_EVENTS] = {"cycles", "instructions", "cache_references", "cache_misses"};
+  unsigned int e = 0;
+
+  fprintf (fp, "    \"%s\": {", name);
+  for (e = 0; e < PERF_NUM_EVENTS; e++) {
+    if (counts -> valid[e]) {
+      fprintf (fp, "\"%s\": %llu", event_names[e], counts -> value[e]);
+    }
+    else {
+      fprintf (fp, "\"%s\": null", event_names[e]);
+    }
+    fprintf (fp, "%s", (e == PERF_NUM_EVENTS - 1) ? "" : ", ");
+  }
+  fprintf (fp, "}%s\n", last ? "" : ",");
+
+  return;
+}
+
+
+/*!  The "counters" member of the --profile report  */
+void printCountersJSON (INFO *info, FILE *fp) {
+  fprintf (fp, "  \"counters\": {\n");
+  printPhaseJSON (fp, "log_likelihood", &(info -> calculateML_perf), false);
+  printPhaseJSON (fp, "e_step", &(info -> applyEStep_perf), false);
+  printPhaseJSON (fp, "m_step", &(info -> applyMStep_perf), false);
+  printPhaseJSON (fp, "normalize", &(info -> normalizeProbs_perf), false);
+  printPhaseJSON (fp, "output", &(info -> printCoProbs_perf), true);
+  fprintf (fp, "  },\n");
+
+  return;
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PERF_H
+#define PERF_H
+
+#if PERF_COUNTERS
+void startCounters (int *fds);
+void stopCounters (int *fds, PERF_COUNTS *counts);
+void printCounters (INFO *info);
+void printCountersJSON (INFO *info, FILE *fp);
+
+/*!  Open the counters of a phase; they count until PERF_STOP  */
+#define PERF_START(FDS) \
+  int FDS[PERF_NUM_EVENTS]; \
+  startCounters (FDS)
+
+/*!  Close the counters of a phase and add them to COUNTS  */
+#define PERF_STOP(FDS,COUNTS) \
+  stopCounters (FDS, &(COUNTS))
+#else
+#define PERF_START(FDS)
+#define PERF_STOP(FDS,COUNTS)
+#endif
+
+void clearCounts (PERF_COUNTS *counts);
+void addCounts (PERF_COUNTS *total, const PERF_COUNTS *counts);
+
+#endif
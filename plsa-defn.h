@@ -62,8 +62,14 @@ typedef float PROBNODE;
 /*!  Macro to perform log (1 + expt(x))  */
 #define DOLOG1PEXP(x) DOLOGONE(DOEXP(x))
 
-/*!  Generate a random number between [0, 1); cast to floating point first to prevent overflow  */
-#define RANDOM_FLOAT ((PROBNODE)rand () / ((PROBNODE)RAND_MAX + (PROBNODE)1.0))
+/*!  Multipliers and key increments of the Philox4x32 generator used for initialization  */
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U
+#define PHILOX_W1 0xBB67AE85U
+
+/*!  Number of rounds of the Philox4x32 generator  */
+#define PHILOX_ROUNDS 10
 
 /*!  Test if two double values are close to each other  */
 #define DBL_LESS(A,B) ((B - A) > DBL_EPSILON)
@@ -71,6 +77,85 @@ typedef float PROBNODE;
 /*!  Minimum difference between two maximum likelihoods  */
 #define ML_DELTA 0.001
 
+/*!  Number of rows handed to a fold-in thread at a time  */
+#define FOLDIN_BATCH 64
+
+/*!  Default number of fold-in iterations per row  */
+#define FOLDIN_MAXITER 20
+
+/*!  Rows handed to an evaluation thread at a time  */
+#define EVAL_BATCH 256
+
+/*!  Initial size of the server's per-connection buffers  */
+#define SERVER_BUFSIZE 65536
+
+/*!  Longest request line the server accepts before dropping the connection  */
+#define SERVER_MAX_REQUEST 16777216
+
+/*!  Most (column id, value) pairs in one FOLDIN request; each takes at least four bytes of a request  */
+#define SERVER_MAX_PAIRS (SERVER_MAX_REQUEST / 4)
+
+/*!  Seconds the server waits to write a reply to a client that is not reading  */
+#define SERVER_WRITE_TIMEOUT 10
+
+/*!  Pending connections queued on the server's socket  */
+#define SERVER_BACKLOG 128
+
+/*!  Factor by which the longest accelerated EM step grows after it succeeds  */
+#define ACCEL_STEP_FACTOR 4.0
+
+/*!  Default decay exponent (kappa) of the online EM step size  */
+#define ONLINE_KAPPA 0.7
+
+/*!  Default delay (tau) of the online EM step size  */
+#define ONLINE_TAU 2.0
+
+/*!  Accumulated log decay at which online EM rescales its statistics  */
+#define ONLINE_REBASE 300.0
+
+/*!  Default factor by which tempered EM lowers beta  */
+#define TEM_BETA_DECAY 0.9
+
+/*!  Tempered EM does not lower beta below this  */
+#define TEM_BETA_MIN 0.5
+
+/*!  Iterations that P(z) must stay below the --prune threshold before a cluster is removed  */
+#define PRUNE_PATIENCE 3
+
+/*!  Orderings of the rows and columns for --reorder  */
+#define REORDER_NONE 0
+#define REORDER_FREQUENCY 1
+#define REORDER_RCM 2
+
+/*!  Placement of the large arrays over NUMA nodes for --numa  */
+#define NUMA_DEFAULT 0
+#define NUMA_INTERLEAVE 1
+#define NUMA_LOCAL 2
+
+/*!  Initialization of P(w2|z):  random, or mixed with rows of the co-occurrence data  */
+#define INIT_RANDOM 0
+#define INIT_SAMPLE 1
+#define INIT_KMEANSPP 2
+
+/*!  Weight of the chosen row against the random values with --init sample or kmeans++  */
+#define INIT_ROW_WEIGHT 0.5
+
+/*!  Nonzeros read at a time by streaming EM, in each of two blocks  */
+#define STREAM_BLOCK_CELLS 1048576
+
+/*!  Size of the stdio buffer used when streaming the co-occurrence file  */
+#define STREAM_BUFSIZE 4194304
+
+/*!  Iterations that --profile has room for before growing its array  */
+#define PROFILE_INITIAL_ITERS 64
+
+/*!  Hardware counters read around each phase in builds with PERF_COUNTERS  */
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_CACHE_REFERENCES 2
+#define PERF_CACHE_MISSES 3
+#define PERF_NUM_EVENTS 4
+
 /*!  ID of the main processor is always 0  */
 #define MAINPROC 0
 
@@ -108,6 +193,14 @@ if (info -> verbose) { \
 #define FCLOSE(FP) \
   (void) fclose (FP);
 
+/*!  Read the monotonic clock into a struct timespec  */
+#define GET_TIME(T) \
+  clock_gettime (CLOCK_MONOTONIC, &(T))
+
+/*!  Seconds between two readings of GET_TIME  */
+#define ELAPSED_TIME(START,END) \
+  ((double) ((END).tv_sec - (START).tv_sec) + (double) ((END).tv_nsec - (START).tv_nsec) / 1e9)
+
 /********************************************************************/
 /*  Functions for accessing cooccurrence structure  */
 
@@ -127,16 +220,16 @@ if (info -> verbose) { \
 /********************************************************************/
 /*  Functions for accessing probabilities  */
 /*!  Function to retrieve from P(w1|z); translate 2D to 1D co-ordinates  */
-#define GET_PROBW1_Z(X,Y) (info -> probw1_z[X * info -> m + Y])
+#define GET_PROBW1_Z(X,Y) (info -> probw1_z[(size_t) (X) * info -> m + (Y)])
 
 /*!  Function to retrieve from P(w2|z); translate 2D to 1D co-ordinates  */
-#define GET_PROBW2_Z(X,Y) (info -> probw2_z[X * info -> n + Y])
+#define GET_PROBW2_Z(X,Y) (info -> probw2_z[(size_t) (X) * info -> n + (Y)])
 
 /*!  Function to retrieve from P(z)  */
 #define GET_PROBZ(X) (info -> probz[X])
 
 /*!  Function to retrieve from P(z|w1w2); translate 3D to 1D co-ordinates  */
-#define GET_PROBZ_W1W2(W,X,Y) (info -> probz_w1w2[W][X * info -> n + Y])
+#define GET_PROBZ_W1W2(W,X,Y) (info -> probz_w1w2[W][(size_t) (X) * info -> n + (Y)])
 
 #define logSumsInline(A,B) \
 {                          \
@@ -162,6 +255,201 @@ typedef struct cooccur {
 } COOCCUR;
 
 
+/*!  Pair of an identifier and its position, for sorting  */
+typedef struct idpos {
+  unsigned int id;
+  unsigned int pos;
+} IDPOS;
+
+
+/*!  Sorted index from row or column identifiers to positions  */
+typedef struct idindex {
+  /*!  Number of identifiers  */
+  unsigned int count;
+  /*!  Identifiers sorted in increasing order, with their positions  */
+  IDPOS *sorted;
+} IDINDEX;
+
+
+/*!  A trained model as written to (and read back from) a model file  */
+typedef struct model {
+  /*!  Number of clusters  */
+  unsigned int num_clusters;
+  /*!  Number of rows  */
+  unsigned int m;
+  /*!  Number of columns  */
+  unsigned int n;
+  /*!  List of row identifiers (m of them)  */
+  unsigned int *row_ids;
+  /*!  List of column identifiers (n of them)  */
+  unsigned int *column_ids;
+  /*!  P(z) of size (k)  */
+  PROBNODE *probz;
+  /*!  P(w1|z) of size (k * m)  */
+  PROBNODE *probw1_z;
+  /*!  P(w2|z) of size (k * n)  */
+  PROBNODE *probw2_z;
+} MODEL;
+
+
+/*!  Rows and columns merged by --dedup and how to expand them again  */
+typedef struct dedup {
+  /*!  Number of rows and columns in the co-occurrence file  */
+  unsigned int m;
+  unsigned int n;
+  /*!  Identifiers of all rows and columns  */
+  unsigned int *row_ids;
+  unsigned int *column_ids;
+  /*!  Identifiers of the rows and columns that were kept  */
+  unsigned int *kept_row_ids;
+  unsigned int *kept_column_ids;
+  /*!  Number of rows that were kept  */
+  unsigned int kept_m;
+  /*!  Kept row (column) that stands for each row (column) of the file  */
+  unsigned int *row_group;
+  unsigned int *column_group;
+  /*!  Log of the number of rows (columns) that each kept row (column) stands for  */
+  PROBNODE *row_weight;
+  PROBNODE *column_weight;
+  /*!  Added to the log-likelihood of the merged data to give that of the original  */
+  PROBNODE ml_offset;
+} DEDUP;
+
+
+/*!  Permutation of the rows and columns applied by --reorder  */
+typedef struct reorder {
+  /*!  Row (column) before reordering at each position  */
+  unsigned int *row_perm;
+  unsigned int *column_perm;
+  /*!  Identifiers before and after reordering  */
+  unsigned int *row_ids;
+  unsigned int *column_ids;
+  unsigned int *reordered_row_ids;
+  unsigned int *reordered_column_ids;
+} REORDER;
+
+
+/*!
+**  Column-major index of the co-occurrences, so that the nonzeros of a
+**  column can be visited without searching the rows
+*/
+typedef struct colindex {
+  /*!  Nonzeros of column j are entries [start[j], start[j + 1])  */
+  size_t *start;
+  /*!  Row of each nonzero, increasing within a column  */
+  unsigned int *row;
+  /*!  Position of each nonzero in its row of (info -> cos)  */
+  unsigned int *pos;
+} COLINDEX;
+
+
+/*!  A cluster removed during training because its P(z) collapsed  */
+typedef struct pruned {
+  /*!  Index of the cluster before any were removed  */
+  unsigned int cluster;
+  /*!  Iteration after which it was removed  */
+  unsigned int iteration;
+  /*!  Its P(z), as a log value  */
+  PROBNODE probz;
+} PRUNED;
+
+
+/*!  Statistics of one of several models trained on the same data  */
+typedef struct restart {
+  /*!  Number of clusters  */
+  unsigned int num_clusters;
+  /*!  Random seed of the restart  */
+  unsigned int seed;
+  /*!  Number of EM iterations performed  */
+  unsigned int iterations;
+  /*!  Final log-likelihood  */
+  PROBNODE ML;
+  /*!  Time taken (seconds)  */
+  double time;
+} RESTART;
+
+
+/*!  Hardware counters of one phase, summed over all of its calls  */
+typedef struct perf_counts {
+  unsigned long long value[PERF_NUM_EVENTS];
+  /*!  Whether the counter could be opened at least once  */
+  bool valid[PERF_NUM_EVENTS];
+} PERF_COUNTS;
+
+
+/*!  Timings of one iteration of one model, for --profile  */
+typedef struct profile_iter {
+  /*!  Number of clusters the model started with, and its seed  */
+  unsigned int model;
+  unsigned int seed;
+  /*!  Iterations completed; 0 is the initial log-likelihood only  */
+  unsigned int iteration;
+  /*!  Number of clusters during the iteration  */
+  unsigned int clusters;
+  /*!  Seconds since the previous iteration, and in each phase  */
+  double seconds;
+  double estep;
+  double mstep;
+  double normalize;
+  double ml;
+  /*!  Whether the log-likelihood was calculated, and its value  */
+  bool evaluated;
+  PROBNODE ML;
+} PROFILE_ITER;
+
+
+/*!  Iterations recorded for --profile  */
+typedef struct profile {
+  PROFILE_ITER *iters;
+  unsigned int num_iters;
+  /*!  Space for iters  */
+  unsigned int capacity;
+  /*!  Clock and phase times at the previous iteration  */
+  struct timespec last;
+  double estep;
+  double mstep;
+  double normalize;
+  double ml;
+} PROFILE;
+
+
+/*!  State of accelerated (SQUAREM) EM  */
+typedef struct accel {
+  /*!  Number of parameters:  k * (1 + m + n)  */
+  size_t size;
+  /*!  Parameters before, after one and after two EM steps  */
+  PROBNODE *theta0;
+  PROBNODE *theta1;
+  PROBNODE *theta2;
+  /*!  Longest step allowed, as a multiple of the EM step  */
+  PROBNODE step_max;
+  /*!  Number of times the plain EM step was used instead  */
+  unsigned int fallbacks;
+} ACCEL;
+
+
+typedef struct sparse {
+  /*!  Number of nonzeros, numbered row by row  */
+  unsigned long num_nonzeros;
+  /*!  Active clusters of nonzero e are active[active_start[e]] to active[active_start[e + 1] - 1]  */
+  size_t *active_start;
+  unsigned int *active;
+  /*!  Space allocated for active  */
+  size_t active_capacity;
+  /*!  Accumulated P(z), P(w1|z) and P(w2|z), one after the other, and whether each was reached  */
+  PROBNODE *acc;
+  bool *flag;
+  /*!  Log of the sum of the counts of each row and column, and of all of them  */
+  PROBNODE *log_row_total;
+  PROBNODE *log_column_total;
+  PROBNODE log_total;
+  /*!  Posteriors of one nonzero  */
+  PROBNODE *post;
+  /*!  Number of EM steps taken  */
+  unsigned int steps;
+} SPARSE;
+
+
 typedef struct info {
   /*!  Verbose output?  */
   bool verbose;
@@ -173,15 +461,70 @@ typedef struct info {
   bool rounding;
   /*!  Suppress output  */
   bool no_output;
+  /*!  Accelerate EM with SQUAREM  */
+  bool accelerate;
+
+  /*!  Read the co-occurrence data from disk on every iteration  */
+  bool stream;
+  /*!  Position of the first row in the co-occurrence file  */
+  long data_offset;
+
+  /*!  Rows per batch of online EM (0 for batch EM)  */
+  unsigned int minibatch;
+  /*!  Stop online EM after this many batches (0 for no limit)  */
+  unsigned int max_batches;
+  /*!  Online EM step size is (t + tau)^-kappa after t batches  */
+  PROBNODE online_kappa;
+  PROBNODE online_tau;
+
+  /*  Termination conditions besides the maximum number of iterations  */
+  /*!  Relative change in log-likelihood, as a percentage  */
+  PROBNODE rtol;
+  /*!  Absolute change in log-likelihood (0 to disable)  */
+  PROBNODE atol;
+  /*!  Largest change in any probability (0 to disable)  */
+  PROBNODE ptol;
+  /*!  Number of consecutive evaluations that must meet rtol or atol  */
+  unsigned int patience;
+  /*!  Calculate the log-likelihood every this many iterations  */
+  unsigned int ml_every;
+
+  /*!  Inverse temperature of the posteriors; 1 for plain EM, lowered by tempered EM  */
+  PROBNODE beta;
+  /*!  Factor by which beta is lowered when the held-out log-likelihood stops improving  */
+  PROBNODE beta_decay;
+  /*!  Fraction of the nonzeros held out for early stopping (0 to disable)  */
+  PROBNODE holdout;
+
+  /*!  Refresh the active clusters of each nonzero every this many iterations (0 for dense EM)  */
+  unsigned int sparse_refresh;
+  /*!  Clusters whose log posterior is below -sparse_cutoff are dropped  */
+  PROBNODE sparse_cutoff;
+
+  /*!  Merge identical rows and columns when reading the co-occurrence file  */
+  bool deduplicate;
+  /*!  Ordering of the rows and columns for locality (REORDER_*)  */
+  unsigned int reorder_mode;
+  /*!  Initialization of P(w2|z) (INIT_*)  */
+  unsigned int init_mode;
+
+  /*!  Remove clusters whose P(z) stays below this (0 to keep them all)  */
+  PROBNODE prune_threshold;
 
   /*!  Random seed  */
   unsigned int seed;
   /*!  Number of clusters  */
   unsigned int num_clusters;
+  /*!  List of numbers of clusters to train models for  */
+  unsigned int *cluster_list;
+  /*!  Length of cluster_list  */
+  unsigned int num_cluster_list;
   /*!  Base filename for the output file  */
   char *base_fn;
   /*!  Maximum number of iterations  */
   unsigned int maxiter;
+  /*!  Number of models to train from different seeds, keeping the best  */
+  unsigned int num_restarts;
   /*!  Number of unique query terms  */
   unsigned int m;
   /*!  Number of terms in the document collection  */
@@ -189,8 +532,39 @@ typedef struct info {
 
   /*!  Co-occurrence filename  */
   char *co_fn;
+  /*!  Model filename to warm-start from (NULL for a random start)  */
+  char *init_model_fn;
+  /*!  Model filename to fold new rows into (NULL to train instead)  */
+  char *foldin_model_fn;
+  /*!  Model filename to evaluate on the co-occurrence file (NULL to train instead)  */
+  char *eval_model_fn;
+  /*!  Unix domain socket to serve requests on (NULL to train instead)  */
+  char *socket_fn;
+  /*!  Model filename loaded by the server  */
+  char *model_fn;
+  /*!  File to write the timings of each phase and iteration to (NULL for none)  */
+  char *profile_fn;
+  /*!  Timings of each iteration; only allocated if profile_fn is set  */
+  PROFILE *profile;
+  /*!  Number of nonzeros that each iteration goes through  */
+  unsigned long num_nonzeros;
+  /*!  Number of worker threads  */
+  unsigned int num_threads;
+  /*!  Threads for the M-step of each model (1 for none)  */
+  unsigned int mstep_threads;
+  /*!  Pages of the large arrays (WM_PAGES_*) and their placement (NUMA_*)  */
+  unsigned int hugepages;
+  unsigned int numa;
   /*!  Co-occurrence counts in a COOCCUR data structure  */
   COOCCUR **cos;
+  /*!  Rows and columns merged by --dedup (NULL if none)  */
+  DEDUP *dedup;
+  /*!  Permutation applied by --reorder (NULL if none)  */
+  REORDER *reorder;
+  /*!  Column-major index of (info -> cos) for the parallel M-step (NULL if none)  */
+  COLINDEX *colindex;
+  /*!  Held-out co-occurrence counts, in the same format (NULL if none)  */
+  COOCCUR **heldout;
   /*!  List of row identifiers (m of them)  */
   unsigned int *row_ids;
   /*!  List of column identifiers (m of them)  */
@@ -198,6 +572,26 @@ typedef struct info {
 
   /*!  Iteration; only calculated by the main process and broadcasted to others  */
   unsigned int iter;
+  /*!  Number of EM iterations completed  */
+  unsigned int iterations;
+  /*!  Log-likelihood after the last iteration  */
+  PROBNODE final_ML;
+  /*!  Log-likelihood of the held-out nonzeros, from the last calculateML ()  */
+  PROBNODE heldout_ML;
+  /*!  Probabilities after the previous normalization; only allocated if ptol is used  */
+  PROBNODE *prev_probs;
+  /*!  Largest change in any probability in the last normalization  */
+  PROBNODE param_change;
+
+  /*!  Number of clusters before any were pruned  */
+  unsigned int initial_clusters;
+  /*!  Index before pruning of each remaining cluster; only allocated if prune_threshold is used  */
+  unsigned int *cluster_ids;
+  /*!  Consecutive iterations that P(z) of each remaining cluster was below prune_threshold  */
+  unsigned int *dead_iters;
+  /*!  Clusters removed so far, in the order they were removed  */
+  PRUNED *pruned;
+  unsigned int num_pruned;
 
   /*!  P(w1|z) of size (k * m)  */
   PROBNODE *probw1_z;
@@ -224,7 +618,7 @@ typedef struct info {
   unsigned int sigfpe_count;
 
   /*  Various times  */
-  time_t program_start;
+  struct timespec program_start;
   double run_time;
   double readCO_time;
   double initEM_time;
@@ -233,7 +627,17 @@ typedef struct info {
   double applyMStep_time;
   double normalizeProbs_time;
   double printCoProbs_time;
-  time_t program_end;
+  /*!  Hardware counters of the phases above (builds with PERF_COUNTERS only)  */
+  PERF_COUNTS calculateML_perf;
+  PERF_COUNTS applyEStep_perf;
+  PERF_COUNTS applyMStep_perf;
+  PERF_COUNTS normalizeProbs_perf;
+  PERF_COUNTS printCoProbs_perf;
+  /*!  Largest number of bytes allocated at once while reading, training and writing out  */
+  size_t readCO_peak;
+  size_t train_peak;
+  size_t output_peak;
+  struct timespec program_end;
 } INFO;
 
 #endif
@@ -0,0 +1,285 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*!
+**  Timings for --profile.  Each training loop calls profileIteration ()
+**  once per iteration, which records the time since the previous call
+**  and how it was split between the phases.  At the end, these and the
+**  total of each phase are written as JSON, or as CSV if the filename
+**  ends in ".csv".  The JSON also has the largest footprint of each
+**  phase and subsystem, as counted by wmalloc ().
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+
+#include "wmalloc.h"
+#include "plsa-defn.h"
+#include "perf.h"
+#include "profile.h"
+
+
+/*!  Start recording the iterations of the model in info  */
+void initProfile (INFO *info) {
+  PROFILE *profile = wmalloc (sizeof (PROFILE));
+
+  profile -> capacity = PROFILE_INITIAL_ITERS;
+  profile -> iters = wmalloc (profile -> capacity * sizeof (PROFILE_ITER));
+  profile -> num_iters = 0;
+  GET_TIME (profile -> last);
+  profile -> estep = info -> applyEStep_time;
+  profile -> mstep = info -> applyMStep_time;
+  profile -> normalize = info -> normalizeProbs_time;
+  profile -> ml = info -> calculateML_time;
+
+  info -> profile = profile;
+
+  return;
+}
+
+
+/*!  Record the time since the previous call as iteration (info -> iter)  */
+void profileIteration (INFO *info, bool evaluated, PROBNODE ML) {
+  PROFILE *profile = info -> profile;
+  PROFILE_ITER *iter = NULL;
+  struct timespec now;
+
+  if (profile == NULL) {
+    return;
+  }
+
+  GET_TIME (now);
+  if (profile -> num_iters == profile -> capacity) {
+    profile -> capacity *= 2;
+    profile -> iters = wrealloc (profile -> iters, profile -> capacity * sizeof (PROFILE_ITER));
+  }
+  iter = &(profile -> iters[profile -> num_iters++]);
+
+  iter -> model = info -> initial_clusters;
+  iter -> seed = info -> seed;
+  iter -> iteration = info -> iter;
+  iter -> clusters = info -> num_clusters;
+  iter -> seconds = ELAPSED_TIME (profile -> last, now);
+  iter -> estep = info -> applyEStep_time - profile -> estep;
+  iter -> mstep = info -> applyMStep_time - profile -> mstep;
+  iter -> normalize = info -> normalizeProbs_time - profile -> normalize;
+  iter -> ml = info -> calculateML_time - profile -> ml;
+  iter -> evaluated = evaluated;
+  iter -> ML = ML;
+
+  profile -> last = now;
+  profile -> estep = info -> applyEStep_time;
+  profile -> mstep = info -> applyMStep_time;
+  profile -> normalize = info -> normalizeProbs_time;
+  profile -> ml = info -> calculateML_time;
+
+  return;
+}
+
+
+/*!  Move the iterations recorded for a model trained on a clone into info  */
+void mergeProfile (INFO *info, INFO *clone) {
+  PROFILE *profile = info -> profile;
+  unsigned int i = 0;
+
+  if (clone -> profile == NULL) {
+    return;
+  }
+  if (profile == NULL) {
+    initProfile (info);
+    profile = info -> profile;
+  }
+
+  for (i = 0; i < clone -> profile -> num_iters; i++) {
+    if (profile -> num_iters == profile -> capacity) {
+      profile -> capacity *= 2;
+      profile -> iters = wrealloc (profile -> iters, profile -> capacity * sizeof (PROFILE_ITER));
+    }
+    profile -> iters[profile -> num_iters++] = clone -> profile -> iters[i];
+  }
+
+  freeProfile (clone -> profile);
+  clone -> profile = NULL;
+
+  return;
+}
+
+
+void freeProfile (PROFILE *profile) {
+  wfree (profile -> iters);
+  wfree (profile);
+
+  return;
+}
+
+
+/*!
+**  Estimate of the bytes read and written by an iteration:  each step of
+**  EM reads every nonzero twice (E- and M-step) and, for each cluster,
+**  reads P(w1|z) and P(w2|z), writes P(z|w1,w2), reads it back and adds
+**  it to P(w1|z) and P(w2|z); calculating the log-likelihood reads every
+**  nonzero once and P(w1|z) and P(w2|z) for each cluster.  Caches are not
+**  taken into account.
+*/
+static double bytesTouched (INFO *info, PROFILE_ITER *iter) {
+  double nonzeros = (double) info -> num_nonzeros;
+  double bytes = 0.0;
+
+  if (iter -> iteration != 0) {
+    bytes += nonzeros * (2 * sizeof (COOCCUR) + 6 * iter -> clusters * sizeof (PROBNODE));
+  }
+  if (iter -> evaluated) {
+    bytes += nonzeros * (sizeof (COOCCUR) + 2 * iter -> clusters * sizeof (PROBNODE));
+  }
+
+  return (bytes);
+}
+
+
+/*!  Nonzeros gone through per second by an iteration (0 if too fast to tell)  */
+static double nonzeroRate (INFO *info, PROFILE_ITER *iter) {
+  if (iter -> seconds <= 0.0) {
+    return (0.0);
+  }
+
+  return ((double) info -> num_nonzeros / iter -> seconds);
+}
+
+
+static void printJSONString (FILE *fp, const char *str) {
+  fputc ('"', fp);
+  for (; (str != NULL) && (*str != '\0'); str++) {
+    if ((*str == '"') || (*str == '\\')) {
+      fputc ('\\', fp);
+    }
+    fputc (*str, fp);
+  }
+  fputc ('"', fp);
+
+  return;
+}
+
+
+static void printProfileJSON (INFO *info, FILE *fp, double total_time) {
+  PROFILE *profile = info -> profile;
+  PROFILE_ITER *iter = NULL;
+  unsigned int num_iters = (profile != NULL) ? profile -> num_iters : 0;
+  unsigned int steps = 0;
+  unsigned int i = 0;
+  double em_time = info -> applyEStep_time + info -> applyMStep_time + info -> normalizeProbs_time;
+
+  for (i = 0; i < num_iters; i++) {
+    if (profile -> iters[i].iteration != 0) {
+      steps++;
+    }
+  }
+
+  fprintf (fp, "{\n");
+  fprintf (fp, "  \"cooccur\": ");
+  printJSONString (fp, info -> co_fn);
+  fprintf (fp, ",\n");
+  fprintf (fp, "  \"rows\": %u,\n", info -> m);
+  fprintf (fp, "  \"columns\": %u,\n", info -> n);
+  fprintf (fp, "  \"nonzeros\": %lu,\n", info -> num_nonzeros);
+  fprintf (fp, "  \"threads\": %u,\n", info -> num_threads);
+  fprintf (fp, "  \"seconds\": %.9f,\n", total_time);
+  fprintf (fp, "  \"phases\": {\n");
+  fprintf (fp, "    \"run\": %.9f,\n", info -> run_time);
+  fprintf (fp, "    \"read\": %.9f,\n", info -> readCO_time);
+  fprintf (fp, "    \"initialize\": %.9f,\n", info -> initEM_time);
+  fprintf (fp, "    \"log_likelihood\": %.9f,\n", info -> calculateML_time);
+  fprintf (fp, "    \"e_step\": %.9f,\n", info -> applyEStep_time);
+  fprintf (fp, "    \"m_step\": %.9f,\n", info -> applyMStep_time);
+  fprintf (fp, "    \"normalize\": %.9f,\n", info -> normalizeProbs_time);
+  fprintf (fp, "    \"output\": %.9f\n", info -> printCoProbs_time);
+  fprintf (fp, "  },\n");
+  fprintf (fp, "  \"memory\": {\n");
+  fprintf (fp, "    \"peak\": %zu,\n", peakWMalloc ());
+  fprintf (fp, "    \"phases\": {\"read\": %zu, \"train\": %zu, \"output\": %zu},\n", info -> readCO_peak, info -> train_peak, info -> output_peak);
+  fprintf (fp, "    \"subsystems\": {");
+  for (i = 0; i < WM_NUM_TAGS; i++) {
+    fprintf (fp, "%s\"%s\": %zu", (i == 0) ? "" : ", ", tagNameWMalloc (i), peakTagWMalloc (i));
+  }
+  fprintf (fp, "}\n");
+  fprintf (fp, "  },\n");
+#if PERF_COUNTERS
+  printCountersJSON (info, fp);
+#endif
+  fprintf (fp, "  \"steps\": %u,\n", steps);
+  fprintf (fp, "  \"nonzeros_per_second\": %.1f,\n", (em_time > 0.0) ? (double) info -> num_nonzeros * steps / em_time : 0.0);
+  fprintf (fp, "  \"iterations\": [");
+  for (i = 0; i < num_iters; i++) {
+    iter = &(profile -> iters[i]);
+    fprintf (fp, "%s\n    {\"model\": %u, \"seed\": %u, \"iteration\": %u, \"clusters\": %u, ", (i == 0) ? "" : ",", iter -> model, iter -> seed, iter -> iteration, iter -> clusters);
+    fprintf (fp, "\"seconds\": %.9f, \"e_step\": %.9f, \"m_step\": %.9f, \"normalize\": %.9f, \"log_likelihood_seconds\": %.9f, ", iter -> seconds, iter -> estep, iter -> mstep, iter -> normalize, iter -> ml);
+    if (iter -> evaluated) {
+      fprintf (fp, "\"log_likelihood\": %f, ", iter -> ML);
+    }
+    else {
+      fprintf (fp, "\"log_likelihood\": null, ");
+    }
+    fprintf (fp, "\"nonzeros_per_second\": %.1f, \"bytes\": %.0f}", nonzeroRate (info, iter), bytesTouched (info, iter));
+  }
+  fprintf (fp, "%s]\n", (num_iters == 0) ? "" : "\n  ");
+  fprintf (fp, "}\n");
+
+  return;
+}
+
+
+static void printProfileCSV (INFO *info, FILE *fp) {
+  PROFILE *profile = info -> profile;
+  PROFILE_ITER *iter = NULL;
+  unsigned int num_iters = (profile != NULL) ? profile -> num_iters : 0;
+  unsigned int i = 0;
+
+  fprintf (fp, "model,seed,iteration,clusters,seconds,e_step,m_step,normalize,log_likelihood_seconds,log_likelihood,nonzeros_per_second,bytes\n");
+  for (i = 0; i < num_iters; i++) {
+    iter = &(profile -> iters[i]);
+    fprintf (fp, "%u,%u,%u,%u,%.9f,%.9f,%.9f,%.9f,%.9f,", iter -> model, iter -> seed, iter -> iteration, iter -> clusters, iter -> seconds, iter -> estep, iter -> mstep, iter -> normalize, iter -> ml);
+    if (iter -> evaluated) {
+      fprintf (fp, "%f", iter -> ML);
+    }
+    fprintf (fp, ",%.1f,%.0f\n", nonzeroRate (info, iter), bytesTouched (info, iter));
+  }
+
+  return;
+}
+
+
+/*!  Write the timings to (info -> profile_fn)  */
+void printProfile (INFO *info) {
+  FILE *fp = NULL;
+  size_t len = strlen (info -> profile_fn);
+  double total_time = ELAPSED_TIME (info -> program_start, info -> program_end);
+
+  FOPEN (info -> profile_fn, fp, "w");
+  if ((len >= 4) && (strcmp (info -> profile_fn + len - 4, ".csv") == 0)) {
+    printProfileCSV (info, fp);
+  }
+  else {
+    printProfileJSON (info, fp, total_time);
+  }
+  FCLOSE (fp);
+
+  return;
+}
@@ -0,0 +1,380 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+**  Reordering of the rows and columns of the co-occurrence data so that
+**  the nonzero loops of EM touch P(w1|z) and P(w2|z) in a more cache
+**  friendly order.  Two orderings are available:
+**
+**    frequency:  columns by decreasing number of nonzeros, so that the
+**                most used parts of P(w2|z) are close together, and rows
+**                by their first (most frequent) column.
+**    rcm:        reverse Cuthill-McKee on the bipartite graph of rows
+**                and columns, which places rows next to the rows they
+**                share columns with, and columns likewise.
+**
+**  The probabilities are put back in the original order before output.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>                                  /*  UINT_MAX  */
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+
+#include "wmalloc.h"
+#include "plsa-defn.h"
+#include "reorder.h"
+
+
+/*!  An item to be sorted by a key, with ties broken by position  */
+typedef struct keyed {
+  unsigned int key;
+  unsigned int pos;
+} KEYED;
+
+
+static int compareKeyed (const void *a, const void *b) {
+  const KEYED *p = (const KEYED*) a;
+  const KEYED *q = (const KEYED*) b;
+
+  if (p -> key != q -> key) {
+    return ((p -> key < q -> key) ? -1 : 1);
+  }
+  if (p -> pos != q -> pos) {
+    return ((p -> pos < q -> pos) ? -1 : 1);
+  }
+
+  return (0);
+}
+
+
+static int compareColumn (const void *a, const void *b) {
+  const COOCCUR *p = (const COOCCUR*) a;
+  const COOCCUR *q = (const COOCCUR*) b;
+
+  if (p -> column != q -> column) {
+    return ((p -> column < q -> column) ? -1 : 1);
+  }
+
+  return (0);
+}
+
+
+/*!  Number of nonzeros of each column  */
+static unsigned int *columnCounts (INFO *info) {
+  unsigned int *count = wmalloc (info -> n * sizeof (unsigned int));
+  unsigned int i;
+  unsigned int j;
+  unsigned int pos;
+
+  for (j = 0; j < info -> n; j++) {
+    count[j] = 0;
+  }
+  for (i = 0; i < info -> m; i++) {
+    for (pos = 1; pos <= info -> cos[i][0].column; pos++) {
+      count[info -> cos[i][pos].column]++;
+    }
+  }
+
+  return (count);
+}
+
+
+/*!  Columns by decreasing frequency; rows by their most frequent column  */
+static void orderByFrequency (INFO *info, unsigned int *row_perm, unsigned int *column_perm) {
+  unsigned int *count = columnCounts (info);
+  unsigned int *rank = wmalloc (info -> n * sizeof (unsigned int));
+  KEYED *keyed = wmalloc (((info -> m > info -> n) ? info -> m : info -> n) * sizeof (KEYED));
+  unsigned int first;
+  unsigned int i;
+  unsigned int j;
+  unsigned int pos;
+
+  for (j = 0; j < info -> n; j++) {
+    keyed[j].key = UINT_MAX - count[j];
+    keyed[j].pos = j;
+  }
+  qsort (keyed, info -> n, sizeof (KEYED), compareKeyed);
+  for (j = 0; j < info -> n; j++) {
+    column_perm[j] = keyed[j].pos;
+    rank[keyed[j].pos] = j;
+  }
+
+  for (i = 0; i < info -> m; i++) {
+    first = UINT_MAX;
+    for (pos = 1; pos <= info -> cos[i][0].column; pos++) {
+      if (rank[info -> cos[i][pos].column] < first) {
+        first = rank[info -> cos[i][pos].column];
+      }
+    }
+    keyed[i].key = first;
+    keyed[i].pos = i;
+  }
+  qsort (keyed, info -> m, sizeof (KEYED), compareKeyed);
+  for (i = 0; i < info -> m; i++) {
+    row_perm[i] = keyed[i].pos;
+  }
+
+  wfree (count);
+  wfree (rank);
+  wfree (keyed);
+
+  return;
+}
+
+
+/*!
+**  Reverse Cuthill-McKee on the bipartite graph whose nodes are the rows
+**  (0 to m - 1) and columns (m to m + n - 1), with an edge for each
+**  nonzero.  Each connected part is started from a node of least degree.
+*/
+static void orderByRCM (INFO *info, unsigned int *row_perm, unsigned int *column_perm) {
+  unsigned int m = info -> m;
+  unsigned int nodes = m + info -> n;
+  unsigned int *count = columnCounts (info);
+  unsigned int *degree = wmalloc (nodes * sizeof (unsigned int));
+  size_t *column_start = wmalloc ((info -> n + 1) * sizeof (size_t));
+  unsigned int *column_rows = NULL;
+  size_t *fill = NULL;
+  unsigned int *queue = wmalloc (nodes * sizeof (unsigned int));
+  bool *visited = wmalloc (nodes * sizeof (bool));
+  KEYED *by_degree = wmalloc (nodes * sizeof (KEYED));
+  KEYED *neighbours = wmalloc ((((m > info -> n) ? m : info -> n) + 1) * sizeof (KEYED));
+  unsigned int head = 0;
+  unsigned int tail = 0;
+  unsigned int next_start = 0;
+  unsigned int num_neighbours;
+  unsigned int node;
+  unsigned int other;
+  unsigned int rows = 0;
+  unsigned int columns = 0;
+  unsigned int i;
+  unsigned int j;
+  unsigned int pos;
+  size_t p;
+
+  /*  Column-major copy of the nonzero pattern  */
+  column_start[0] = 0;
+  for (j = 0; j < info -> n; j++) {
+    column_start[j + 1] = column_start[j] + count[j];
+  }
+  column_rows = wmalloc ((column_start[info -> n] + 1) * sizeof (unsigned int));
+  fill = wmalloc (info -> n * sizeof (size_t));
+  memcpy (fill, column_start, info -> n * sizeof (size_t));
+  for (i = 0; i < m; i++) {
+    for (pos = 1; pos <= info -> cos[i][0].column; pos++) {
+      column_rows[fill[info -> cos[i][pos].column]++] = i;
+    }
+  }
+  wfree (fill);
+
+  for (node = 0; node < nodes; node++) {
+    degree[node] = (node < m) ? info -> cos[node][0].column : count[node - m];
+    visited[node] = false;
+    by_degree[node].key = degree[node];
+    by_degree[node].pos = node;
+  }
+  qsort (by_degree, nodes, sizeof (KEYED), compareKeyed);
+
+  while (tail < nodes) {
+    /*  Start the next connected part  */
+    while (visited[by_degree[next_start].pos]) {
+      next_start++;
+    }
+    queue[tail++] = by_degree[next_start].pos;
+    visited[by_degree[next_start].pos] = true;
+
+    while (head < tail) {
+      node = queue[head++];
+      num_neighbours = 0;
+      if (node < m) {
+        for (pos = 1; pos <= info -> cos[node][0].column; pos++) {
+          other = m + info -> cos[node][pos].column;
+          if (!visited[other]) {
+            neighbours[num_neighbours].key = degree[other];
+            neighbours[num_neighbours++].pos = other;
+            visited[other] = true;
+          }
+        }
+      }
+      else {
+        for (p = column_start[node - m]; p < column_start[node - m + 1]; p++) {
+          other = column_rows[p];
+          if (!visited[other]) {
+            neighbours[num_neighbours].key = degree[other];
+            neighbours[num_neighbours++].pos = other;
+            visited[other] = true;
+          }
+        }
+      }
+      qsort (neighbours, num_neighbours, sizeof (KEYED), compareKeyed);
+      for (pos = 0; pos < num_neighbours; pos++) {
+        queue[tail++] = neighbours[pos].pos;
+      }
+    }
+  }
+
+  /*  Reverse the order, then split it into rows and columns  */
+  for (pos = nodes; pos > 0; pos--) {
+    node = queue[pos - 1];
+    if (node < m) {
+      row_perm[rows++] = node;
+    }
+    else {
+      column_perm[columns++] = node - m;
+    }
+  }
+
+  wfree (count);
+  wfree (degree);
+  wfree (column_start);
+  wfree (column_rows);
+  wfree (queue);
+  wfree (visited);
+  wfree (by_degree);
+  wfree (neighbours);
+
+  return;
+}
+
+
+/*!  Renumber the columns of some rows and sort each row by its new columns  */
+static void relabelRows (COOCCUR **rows, unsigned int m, const unsigned int *column_rank) {
+  unsigned int i;
+  unsigned int pos;
+
+  for (i = 0; i < m; i++) {
+    for (pos = 1; pos <= rows[i][0].column; pos++) {
+      rows[i][pos].column = column_rank[rows[i][pos].column];
+    }
+    qsort (rows[i] + 1, rows[i][0].column, sizeof (COOCCUR), compareColumn);
+  }
+
+  return;
+}
+
+
+/*!
+**  Reorder the rows and columns of the co-occurrence data just read,
+**  according to (info -> reorder_mode).  (info -> reorder) records the
+**  permutation so that restoreOrder () can undo it.
+*/
+void reorderCO (INFO *info) {
+  REORDER *reorder = wmalloc (sizeof (REORDER));
+  unsigned int *column_rank = wmalloc (info -> n * sizeof (unsigned int));
+  COOCCUR **rows = wmalloc (info -> m * sizeof (COOCCUR*));
+  unsigned int i;
+  unsigned int j;
+  struct timespec start;
+  struct timespec end;
+
+  GET_TIME (start);
+
+  reorder -> row_perm = wmallocTag (info -> m * sizeof (unsigned int), WM_TAG_INDEX);
+  reorder -> column_perm = wmallocTag (info -> n * sizeof (unsigned int), WM_TAG_INDEX);
+  if (info -> reorder_mode == REORDER_RCM) {
+    orderByRCM (info, reorder -> row_perm, reorder -> column_perm);
+  }
+  else {
+    orderByFrequency (info, reorder -> row_perm, reorder -> column_perm);
+  }
+
+  for (j = 0; j < info -> n; j++) {
+    column_rank[reorder -> column_perm[j]] = j;
+  }
+
+  for (i = 0; i < info -> m; i++) {
+    rows[i] = info -> cos[reorder -> row_perm[i]];
+  }
+  memcpy (info -> cos, rows, info -> m * sizeof (COOCCUR*));
+  relabelRows (info -> cos, info -> m, column_rank);
+
+  if (info -> heldout != NULL) {
+    for (i = 0; i < info -> m; i++) {
+      rows[i] = info -> heldout[reorder -> row_perm[i]];
+    }
+    memcpy (info -> heldout, rows, info -> m * sizeof (COOCCUR*));
+    relabelRows (info -> heldout, info -> m, column_rank);
+  }
+
+  reorder -> row_ids = info -> row_ids;
+  reorder -> column_ids = info -> column_ids;
+  reorder -> reordered_row_ids = wmallocTag (info -> m * sizeof (unsigned int), WM_TAG_INDEX);
+  reorder -> reordered_column_ids = wmallocTag (info -> n * sizeof (unsigned int), WM_TAG_INDEX);
+  for (i = 0; i < info -> m; i++) {
+    reorder -> reordered_row_ids[i] = info -> row_ids[reorder -> row_perm[i]];
+  }
+  for (j = 0; j < info -> n; j++) {
+    reorder -> reordered_column_ids[j] = info -> column_ids[reorder -> column_perm[j]];
+  }
+  info -> row_ids = reorder -> reordered_row_ids;
+  info -> column_ids = reorder -> reordered_column_ids;
+  info -> reorder = reorder;
+
+  wfree (rows);
+  wfree (column_rank);
+
+  GET_TIME (end);
+  info -> readCO_time += ELAPSED_TIME (start, end);
+
+  return;
+}
+
+
+/*!  Put P(w1|z), P(w2|z) and the identifiers of a trained model back in their original order  */
+void restoreOrder (INFO *info) {
+  REORDER *reorder = info -> reorder;
+  PROBNODE *probw1_z = wmallocTag ((size_t) info -> num_clusters * info -> m * sizeof (PROBNODE), WM_TAG_MODEL);
+  PROBNODE *probw2_z = wmallocTag ((size_t) info -> num_clusters * info -> n * sizeof (PROBNODE), WM_TAG_MODEL);
+  unsigned int k;
+  unsigned int i;
+  unsigned int j;
+
+  for (k = 0; k < info -> num_clusters; k++) {
+    for (i = 0; i < info -> m; i++) {
+      probw1_z[(size_t) k * info -> m + reorder -> row_perm[i]] = GET_PROBW1_Z (k, i);
+    }
+    for (j = 0; j < info -> n; j++) {
+      probw2_z[(size_t) k * info -> n + reorder -> column_perm[j]] = GET_PROBW2_Z (k, j);
+    }
+  }
+
+  wfree (info -> probw1_z);
+  wfree (info -> probw2_z);
+  info -> probw1_z = probw1_z;
+  info -> probw2_z = probw2_z;
+  info -> row_ids = reorder -> row_ids;
+  info -> column_ids = reorder -> column_ids;
+
+  return;
+}
+
+
+void freeReorder (REORDER *reorder) {
+  wfree (reorder -> row_perm);
+  wfree (reorder -> column_perm);
+  wfree (reorder -> reordered_row_ids);
+  wfree (reorder -> reordered_column_ids);
+  wfree (reorder);
+
+  return;
+}
+
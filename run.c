@@ -22,13 +22,23 @@
 #include <stdbool.h>
 #include <math.h>  /*  fabs  */
 #include <float.h>  /*  DBL_EPSILON  */
+#include <string.h>
 #include <time.h>
 #include <signal.h>
+#include <pthread.h>
 
 #include "wmalloc.h"
 #include "plsa-defn.h"
 #include "em-estep.h"
 #include "em-mstep.h"
+#include "em-accel.h"
+#include "em-online.h"
+#include "em-stream.h"
+#include "em-sparse.h"
+#include "dedup.h"
+#include "reorder.h"
+#include "profile.h"
+#include "perf.h"
 #include "input.h"
 #include "output.h"
 #include "parameters.h"
@@ -39,7 +49,7 @@
 INFO *initialize () {
   INFO *info = wmalloc (sizeof (INFO));
 
-  time (&(info -> program_start));
+  GET_TIME (info -> program_start);
   info -> run_time = 0;
   info -> readCO_time = 0;
   info -> initEM_time = 0;
@@ -48,6 +58,36 @@ INFO *initialize () {
   info -> applyMStep_time = 0;
   info -> normalizeProbs_time = 0;
   info -> printCoProbs_time = 0;
+  clearCounts (&(info -> calculateML_perf));
+  clearCounts (&(info -> applyEStep_perf));
+  clearCounts (&(info -> applyMStep_perf));
+  clearCounts (&(info -> normalizeProbs_perf));
+  clearCounts (&(info -> printCoProbs_perf));
+  info -> readCO_peak = 0;
+  info -> train_peak = 0;
+  info -> output_peak = 0;
+
+  info -> cos = NULL;
+  info -> heldout = NULL;
+  info -> dedup = NULL;
+  info -> reorder = NULL;
+  info -> colindex = NULL;
+  info -> profile = NULL;
+  info -> num_nonzeros = 0;
+  info -> mstep_threads = 1;
+  info -> hugepages = WM_PAGES_DEFAULT;
+  info -> numa = NUMA_DEFAULT;
+  info -> row_ids = NULL;
+  info -> column_ids = NULL;
+  info -> probw1_z = NULL;
+  info -> probw2_z = NULL;
+  info -> probz = NULL;
+  info -> probz_w1w2 = NULL;
+  info -> prev_probs = NULL;
+  info -> cluster_ids = NULL;
+  info -> dead_iters = NULL;
+  info -> pruned = NULL;
+  info -> num_pruned = 0;
 
   /*  MPI unavailable in this version  */
   info -> world_id = MAINPROC;
@@ -61,35 +101,149 @@ INFO *initialize () {
 }
 
 
-void uninitialize (INFO *info) {
-  double total_time = 0;
+/*!  Allocate the probabilities needed by EM; requires m and n to be known  */
+void allocateProbs (INFO *info) {
+  unsigned int size = info -> num_clusters;
   unsigned int k = 0;
 
-  wfree (info -> cos);
+  info -> probw1_z = wmallocTag ((size_t) size * info -> m * sizeof (PROBNODE), WM_TAG_MODEL);
+  info -> probw2_z = wmallocTag ((size_t) size * info -> n * sizeof (PROBNODE), WM_TAG_MODEL);
+  info -> probz = wmallocTag (size * sizeof (PROBNODE), WM_TAG_MODEL);
+
+  info -> initial_clusters = size;
+  info -> num_pruned = 0;
+  if (info -> prune_threshold > 0) {
+    info -> cluster_ids = wmalloc (size * sizeof (unsigned int));
+    info -> dead_iters = wmalloc (size * sizeof (unsigned int));
+    info -> pruned = wmalloc (size * sizeof (PRUNED));
+    for (k = 0; k < size; k++) {
+      info -> cluster_ids[k] = k;
+      info -> dead_iters[k] = 0;
+    }
+  }
+
+  /*  Online, streaming and sparse EM compute the posteriors as they go  */
+  if ((info -> minibatch != 0) || (info -> stream) || (info -> sparse_refresh != 0)) {
+    info -> probz_w1w2 = NULL;
+    return;
+  }
+
+  info -> probz_w1w2 = wmallocTag (size * sizeof (PROBNODE*), WM_TAG_POSTERIOR);
+  for (k = 0; k < size; k++) {
+    info -> probz_w1w2[k] = wmallocTag ((size_t) info -> m * info -> n * sizeof (PROBNODE), WM_TAG_POSTERIOR);
+  }
+
+  if ((info -> numa == NUMA_LOCAL) && (info -> colindex != NULL)) {
+    touchMStepPartitions (info);
+  }
+
+  return;
+}
+
+
+/*!  Free P(z|w1w2), which is needed only while training  */
+void freePosteriors (INFO *info) {
+  unsigned int k = 0;
+
+  if (info -> probz_w1w2 != NULL) {
+    for (k = 0; k < info -> num_clusters; k++) {
+      wfree (info -> probz_w1w2[k]);
+    }
+    wfree (info -> probz_w1w2);
+  }
+  info -> probz_w1w2 = NULL;
+
+  return;
+}
+
+
+void freeProbs (INFO *info) {
   wfree (info -> probw1_z);
   wfree (info -> probw2_z);
   wfree (info -> probz);
+  wfree (info -> cluster_ids);
+  wfree (info -> dead_iters);
+  wfree (info -> pruned);
+  freePosteriors (info);
+
+  info -> probw1_z = NULL;
+  info -> probw2_z = NULL;
+  info -> probz = NULL;
+  info -> cluster_ids = NULL;
+  info -> dead_iters = NULL;
+  info -> pruned = NULL;
+
+  return;
+}
+
+
+void uninitialize (INFO *info) {
+  double total_time = 0;
+  unsigned int rows = info -> m;
+  unsigned int i = 0;
+
+  GET_TIME (info -> program_end);
+
+  if (info -> profile_fn != NULL) {
+    printProfile (info);
+  }
+  if (info -> profile != NULL) {
+    freeProfile (info -> profile);
+  }
+
+  /*  With merged rows, info -> m may have been expanded again  */
+  if (info -> dedup != NULL) {
+    rows = info -> dedup -> kept_m;
+  }
 
-  for (k = 0; k < info -> num_clusters; k++) {
-    wfree (info -> probz_w1w2[k]);
+  if (info -> cos != NULL) {
+    for (i = 0; i < rows; i++) {
+      wfree (info -> cos[i]);
+    }
   }
-  wfree (info -> probz_w1w2);
+  wfree (info -> cos);
+  if (info -> heldout != NULL) {
+    for (i = 0; i < info -> m; i++) {
+      wfree (info -> heldout[i]);
+    }
+  }
+  wfree (info -> heldout);
+  if (info -> colindex != NULL) {
+    freeColumnIndex (info -> colindex);
+  }
+  freeProbs (info);
   wfree (info -> base_fn);
   wfree (info -> co_fn);
-  wfree (info -> row_ids);
-  wfree (info -> column_ids);
-
-  time (&(info -> program_end));
+  wfree (info -> init_model_fn);
+  wfree (info -> foldin_model_fn);
+  wfree (info -> eval_model_fn);
+  wfree (info -> socket_fn);
+  wfree (info -> model_fn);
+  /*  The identifiers belong to the merged rows and columns, if any  */
+  if (info -> reorder != NULL) {
+    info -> row_ids = info -> reorder -> row_ids;
+    info -> column_ids = info -> reorder -> column_ids;
+    freeReorder (info -> reorder);
+  }
+  if (info -> dedup != NULL) {
+    freeDedup (info -> dedup);
+  }
+  else {
+    wfree (info -> row_ids);
+    wfree (info -> column_ids);
+  }
+  wfree (info -> cluster_list);
+  wfree (info -> profile_fn);
 
   if (info -> verbose) {
-    total_time = difftime (info -> program_end, info -> program_start);
+    total_time = ELAPSED_TIME (info -> program_start, info -> program_end);
     if (total_time > 60) {
       fprintf (stderr, "==\tProgram execution:                              %.3f mins\n", total_time / 60);
     }
     else {
       fprintf (stderr, "==\tProgram execution:                              %.3f secs\n", total_time);
     }
-    if (total_time > 1) {
+    if (total_time > 0) {
       fprintf (stderr, "==\t  run() time:                                   %6.2f %%\n", info -> run_time / total_time * 100);
 
       fprintf (stderr, "==\t    Read data in:                               %6.2f %%\n", info -> readCO_time / total_time * 100);
@@ -99,7 +253,11 @@ void uninitialize (INFO *info) {
       fprintf (stderr, "==\t    Apply M step:                               %6.2f %%\n", info -> applyMStep_time / total_time * 100);
       fprintf (stderr, "==\t    Normalize probabilities:                    %6.2f %%\n", info -> normalizeProbs_time / total_time * 100);
       fprintf (stderr, "==\t    Print probabilities:                        %6.2f %%\n", info -> printCoProbs_time / total_time * 100);
+#if PERF_COUNTERS
+      printCounters (info);
+#endif
     }
+    printWMalloc ();
   }
 
   wfree (info);
@@ -108,55 +266,129 @@ void uninitialize (INFO *info) {
 }
 
 
-bool run (INFO *info) {
+/*!
+**  Run EM from the current parameters until convergence or the maximum
+**  number of iterations.  Returns the final log-likelihood, which is also
+**  kept in the INFO structure along with the number of iterations.
+*/
+static PROBNODE trainEM (INFO *info) {
   PROBNODE curr_ML = 0;
   PROBNODE prev_ML = 0;
   PROBNODE diff = 0.0;
-
-  info -> iter = 0;
-
-  time_t start;
-  time_t end;
-  time_t loop_start;
-  time_t loop_end;
+  ACCEL *accel = NULL;
+  SPARSE *sparse = NULL;
+  unsigned int stalls = 0;  /*  Consecutive evaluations that met the tolerance  */
+  bool evaluated = false;
+  PROBNODE *best_probs = NULL;
+  PROBNODE best_heldout = 0.0;
+  bool improved = false;  /*  Whether the held-out log-likelihood improved at this beta  */
+  unsigned int iter = 0;
+
+  struct timespec loop_start;
+  struct timespec loop_end;
   double timediff = 0.0;
 
-  time (&start);
+  info -> iter = 0;
+  info -> iterations = 0;
 
-  /*  All processes read in co-occurrence data  */
-  if (!readCO (info)) {
-    /*  If there is an error, all processes are terminated  */
-    fprintf (stderr, "Error reading co-occurrence data.\n");
-    return false;
+  if (info -> accelerate) {
+    accel = initAccel (info);
   }
-
-  /*  Only the main process initializes to ensure the random seed affects it only  */
-  initEM (info);
-  if (info -> verbose) {
-    fprintf (stderr, "==\tm = %u; n = %u\n", info -> m, info -> n);
+  if (info -> sparse_refresh != 0) {
+    sparse = initSparse (info);
   }
 
+  /*  Normalization compares against the previous probabilities  */
+  initPrevProbs (info);
 
-  time (&loop_start);
+  if (info -> heldout != NULL) {
+    best_probs = wmallocTag ((size_t) info -> num_clusters * (1 + (size_t) info -> m + info -> n) * sizeof (PROBNODE), WM_TAG_ENGINE);
+  }
+
+  GET_TIME (loop_start);
   while (true) {
-    curr_ML = calculateML (info);
+    /*  The safeguard of accelerated EM needs the log-likelihood every time  */
+    evaluated = ((info -> iter == 0) || (accel != NULL) || (info -> iter % info -> ml_every == 0));
 
-    if (info -> iter == 0) {
-      if (info -> verbose) {
-        fprintf (stderr, "[---]  Initial = %f\n", curr_ML);
+    if (evaluated) {
+      iter = info -> iter;
+      curr_ML = calculateML (info);
+
+      /*  Safeguard:  use the plain EM step if extrapolation made things worse  */
+      if ((accel != NULL) && (info -> iter != 0) && (curr_ML < prev_ML)) {
+        undoAccelStep (info, accel);
+        curr_ML = calculateML (info);
       }
     }
-    else {
-      diff = (curr_ML - prev_ML) / prev_ML * 100 * -1;
-      if (info -> verbose) {
-        fprintf (stderr, "[%3u]  %f --> %f\t[%f, %2.4f %%]\n", info -> iter, prev_ML, curr_ML, (curr_ML - prev_ML), diff);
+
+    profileIteration (info, evaluated, curr_ML);
+
+    if (evaluated) {
+      if (info -> iter == 0) {
+        if (info -> verbose) {
+          fprintf (stderr, "[---]  Initial = %f\n", curr_ML);
+        }
       }
-      if ((curr_ML < prev_ML) || (DBL_LESS (fabs (diff), ML_DELTA))) {
-        info -> iter = UINT_MAX;  /*  Set an indicator to leave loop  */
+      else {
+        diff = (curr_ML - prev_ML) / prev_ML * 100 * -1;
+        if (info -> verbose) {
+          fprintf (stderr, "[%3u]  %f --> %f\t[%f, %2.4f %%]\n", info -> iter, prev_ML, curr_ML, (curr_ML - prev_ML), diff);
+        }
+        /*  Tempered EM does not maximize the log-likelihood, so it may decrease  */
+        if ((curr_ML < prev_ML) && (info -> beta >= 1.0)) {
+          info -> iter = UINT_MAX;  /*  Set an indicator to leave loop  */
+        }
+        else if ((DBL_LESS (fabs (diff), info -> rtol)) || (fabs (curr_ML - prev_ML) < info -> atol)) {
+          stalls++;
+          if (stalls >= info -> patience) {
+            info -> iter = UINT_MAX;  /*  Set an indicator to leave loop  */
+          }
+        }
+        else {
+          stalls = 0;
+        }
+      }
+
+      prev_ML = curr_ML;
+
+      /*  Early stopping (tempered EM):  keep the parameters with the best
+      **  held-out log-likelihood.  When it stops improving, go back to them
+      **  and lower beta, unless the last lowering did not help either.  */
+      if (best_probs != NULL) {
+        if (info -> verbose) {
+          fprintf (stderr, "[%3u]  Held-out = %f\t(beta = %f)\n", iter, info -> heldout_ML, info -> beta);
+        }
+        if ((iter == 0) || (info -> heldout_ML > best_heldout)) {
+          best_heldout = info -> heldout_ML;
+          saveProbs (info, best_probs);
+          improved = (iter != 0);
+        }
+        else {
+          restoreProbs (info, best_probs);
+          curr_ML = calculateML (info);
+          prev_ML = curr_ML;
+          stalls = 0;
+
+          if ((!improved) || (info -> beta_decay >= 1.0) || (info -> beta * info -> beta_decay < TEM_BETA_MIN)) {
+            info -> iter = UINT_MAX;  /*  Set an indicator to leave loop  */
+          }
+          else if (info -> iter != UINT_MAX) {
+            info -> beta *= info -> beta_decay;
+            improved = false;
+            if (info -> verbose) {
+              fprintf (stderr, "[%3u]  Held-out log-likelihood stopped improving; beta lowered to %f\n", iter, info -> beta);
+            }
+          }
+        }
       }
     }
 
-    prev_ML = curr_ML;
+    if ((info -> ptol > 0) && (info -> iter != 0) && (info -> iter != UINT_MAX) && (info -> param_change < info -> ptol)) {
+      if (info -> verbose) {
+        fprintf (stderr, "[%3u]  Largest change in a probability:  %g\n", info -> iter, info -> param_change);
+      }
+      info -> iter = UINT_MAX;  /*  Set an indicator to leave loop  */
+    }
 
 #if DEBUG
     checkCoProb (info);
@@ -175,26 +407,374 @@ bool run (INFO *info) {
       break;
     }
 
+    if (accel != NULL) {
+      applyAccelStep (info, accel);
+      continue;
+    }
+
+    if (sparse != NULL) {
+      applySparseStep (info, sparse);
+      info -> iterations++;
+      continue;
+    }
+
     applyEStep (info);
 
     /*  Calculate M-step  */
     applyMStep (info);
 
     normalizeProbs (info);
+    info -> iterations++;
   }
-  time (&loop_end);
-  timediff += difftime (loop_end, loop_start);
+  GET_TIME (loop_end);
+  timediff += ELAPSED_TIME (loop_start, loop_end);
 
-  if (info -> maxiter == 1) {
+  if ((info -> maxiter == 1) && (info -> verbose)) {
     fprintf (stderr, "==\t  Main loop [one iteration only!]:             %6.2f %% (%f)\n", 0.0, timediff);
   }
 
+  /*  The last iteration might not have been evaluated  */
+  if (!evaluated) {
+    curr_ML = calculateML (info);
+  }
+
+  freePrevProbs (info);
+  wfree (best_probs);
+  if (sparse != NULL) {
+    freeSparse (sparse);
+  }
+
+  if (accel != NULL) {
+    if (info -> verbose) {
+      fprintf (stderr, "==\tEM steps (including accelerated):               %u\n", info -> iterations);
+      fprintf (stderr, "==\tAccelerated steps rejected:                     %u\n", accel -> fallbacks);
+    }
+    freeAccel (accel);
+  }
+
+  info -> final_ML = curr_ML;
+
+  return (curr_ML);
+}
+
+
+/*!  Train with batch or online EM, as chosen  */
+static PROBNODE trainModel (INFO *info) {
+  if (info -> profile_fn != NULL) {
+    initProfile (info);
+  }
+
+  if (info -> minibatch != 0) {
+    return (trainOnline (info));
+  }
+
+  if (info -> stream) {
+    return (trainStream (info));
+  }
+
+  return (trainEM (info));
+}
+
+
+/*!
+**  Copy of the settings for training another model on the same data.
+**  The co-occurrence data and identifiers are shared with the original;
+**  the probabilities are not allocated.
+*/
+static INFO *cloneInfo (INFO *info) {
+  INFO *clone = wmalloc (sizeof (INFO));
+
+  memcpy (clone, info, sizeof (INFO));
+  clone -> verbose = false;
+  clone -> debug = false;
+  clone -> probw1_z = NULL;
+  clone -> probw2_z = NULL;
+  clone -> probz = NULL;
+  clone -> probz_w1w2 = NULL;
+  clone -> cluster_ids = NULL;
+  clone -> dead_iters = NULL;
+  clone -> pruned = NULL;
+  clone -> profile = NULL;
+
+  clone -> initEM_time = 0;
+  clone -> calculateML_time = 0;
+  clone -> applyEStep_time = 0;
+  clone -> applyMStep_time = 0;
+  clone -> normalizeProbs_time = 0;
+  clearCounts (&(clone -> calculateML_perf));
+  clearCounts (&(clone -> applyEStep_perf));
+  clearCounts (&(clone -> applyMStep_perf));
+  clearCounts (&(clone -> normalizeProbs_perf));
+  clearCounts (&(clone -> printCoProbs_perf));
+
+  return (clone);
+}
+
+
+static void freeClone (INFO *clone) {
+  freeProbs (clone);
+  wfree (clone);
+
+  return;
+}
+
+
+/*!  State shared by the threads that train the models  */
+typedef struct train_work {
+  INFO *info;
+  /*!  Model with the best final log-likelihood so far, for each number of clusters  */
+  INFO **best;
+  /*!  Statistics of each model, ordered by number of clusters and then restart  */
+  RESTART *restarts;
+  /*!  Indices into the list of cluster counts, largest first  */
+  unsigned int *order;
+  /*!  Next model to be handed out  */
+  unsigned int next_job;
+  pthread_mutex_t lock;
+} TRAIN_WORK;
+
+
+static void *trainWorker (void *arg) {
+  TRAIN_WORK *work = (TRAIN_WORK*) arg;
+  INFO *info = work -> info;
+  INFO *clone = NULL;
+  unsigned int job = 0;
+  unsigned int c = 0;  /*  Index into the list of cluster counts  */
+  unsigned int r = 0;  /*  Restart  */
+  struct timespec start;
+  struct timespec end;
+
+  while (true) {
+    pthread_mutex_lock (&(work -> lock));
+    job = work -> next_job++;
+    pthread_mutex_unlock (&(work -> lock));
+    if (job >= info -> num_cluster_list * info -> num_restarts) {
+      break;
+    }
+    /*  The largest models are handed out first so that the threads finish together  */
+    c = work -> order[job / info -> num_restarts];
+    r = job % info -> num_restarts;
+    job = c * info -> num_restarts + r;
+
+    GET_TIME (start);
+    clone = cloneInfo (info);
+    clone -> num_clusters = info -> cluster_list[c];
+    clone -> block_size = clone -> num_clusters;
+    clone -> seed = info -> seed + r;
+    allocateProbs (clone);
+
+    /*  The initial values depend only on the seed of the model  */
+    initEM (clone);
+
+    trainModel (clone);
+    freePosteriors (clone);
+    GET_TIME (end);
+
+    pthread_mutex_lock (&(work -> lock));
+    work -> restarts[job].num_clusters = clone -> initial_clusters;
+    work -> restarts[job].seed = clone -> seed;
+    work -> restarts[job].iterations = clone -> iterations;
+    work -> restarts[job].ML = clone -> final_ML;
+    work -> restarts[job].time = ELAPSED_TIME (start, end);
+
+    info -> initEM_time += clone -> initEM_time;
+    info -> calculateML_time += clone -> calculateML_time;
+    info -> applyEStep_time += clone -> applyEStep_time;
+    info -> applyMStep_time += clone -> applyMStep_time;
+    info -> normalizeProbs_time += clone -> normalizeProbs_time;
+    addCounts (&(info -> calculateML_perf), &(clone -> calculateML_perf));
+    addCounts (&(info -> applyEStep_perf), &(clone -> applyEStep_perf));
+    addCounts (&(info -> applyMStep_perf), &(clone -> applyMStep_perf));
+    addCounts (&(info -> normalizeProbs_perf), &(clone -> normalizeProbs_perf));
+    mergeProfile (info, clone);
+
+    /*  Keep only the best model for each number of clusters; ties go to
+    **  the earliest restart regardless of the order the threads finish  */
+    if ((work -> best[c] == NULL) || (clone -> final_ML > work -> best[c] -> final_ML) ||
+        ((clone -> final_ML == work -> best[c] -> final_ML) && (clone -> seed < work -> best[c] -> seed))) {
+      if (work -> best[c] != NULL) {
+        freeClone (work -> best[c]);
+      }
+      work -> best[c] = clone;
+    }
+    else {
+      freeClone (clone);
+    }
+    pthread_mutex_unlock (&(work -> lock));
+  }
+
+  return (NULL);
+}
+
+
+/*!
+**  Write the model trained for one of several numbers of clusters, using
+**  the base filename with ".k<clusters>" appended.
+*/
+static void printSweepModel (INFO *info, INFO *model) {
+  char *base_fn = wmalloc (sizeof (char) * (strlen (info -> base_fn) + 16));
+
+  sprintf (base_fn, "%s.k%u", info -> base_fn, model -> initial_clusters);
+  model -> base_fn = base_fn;
+  model -> verbose = info -> verbose;
+
+  if (model -> reorder != NULL) {
+    restoreOrder (model);
+  }
+  if (model -> dedup != NULL) {
+    expandProbs (model);
+  }
+
   if (!info -> no_output) {
-    printCoProb (info);
+    printCoProb (model);
+  }
+  printModel (model);
+  if (model -> prune_threshold > 0) {
+    printPruned (model);
+  }
+  info -> printCoProbs_time += model -> printCoProbs_time;
+  addCounts (&(info -> printCoProbs_perf), &(model -> printCoProbs_perf));
+
+  model -> base_fn = info -> base_fn;
+  wfree (base_fn);
+
+  return;
+}
+
+
+/*!
+**  Train a model for each number of clusters in (info -> cluster_list)
+**  and each of (info -> num_restarts) seeds on the same data, using up to
+**  (info -> num_threads) threads.  For each number of clusters, the model
+**  with the highest final log-likelihood is kept.  With a single number
+**  of clusters, the kept model is moved into info; otherwise, each one is
+**  written out here.
+*/
+static void trainModels (INFO *info) {
+  TRAIN_WORK work;
+  pthread_t *threads = NULL;
+  unsigned int num_jobs = info -> num_cluster_list * info -> num_restarts;
+  unsigned int num_threads = info -> num_threads;
+  unsigned int c = 0;
+  unsigned int i = 0;
+
+  if (num_threads > num_jobs) {
+    num_threads = num_jobs;
+  }
+
+  work.info = info;
+  work.best = wmalloc (info -> num_cluster_list * sizeof (INFO*));
+  for (c = 0; c < info -> num_cluster_list; c++) {
+    work.best[c] = NULL;
+  }
+  work.restarts = wmalloc (num_jobs * sizeof (RESTART));
+  work.order = wmalloc (info -> num_cluster_list * sizeof (unsigned int));
+  for (c = 0; c < info -> num_cluster_list; c++) {
+    for (i = c; (i > 0) && (info -> cluster_list[work.order[i - 1]] < info -> cluster_list[c]); i--) {
+      work.order[i] = work.order[i - 1];
+    }
+    work.order[i] = c;
+  }
+  work.next_job = 0;
+  pthread_mutex_init (&(work.lock), NULL);
+
+  threads = wmalloc (num_threads * sizeof (pthread_t));
+  for (i = 0; i < num_threads; i++) {
+    pthread_create (&(threads[i]), NULL, trainWorker, &work);
+  }
+  for (i = 0; i < num_threads; i++) {
+    pthread_join (threads[i], NULL);
+  }
+  pthread_mutex_destroy (&(work.lock));
+
+  if (info -> num_restarts > 1) {
+    printRestarts (info, work.restarts);
+  }
+
+  if (info -> num_cluster_list == 1) {
+    /*  Adopt the probabilities of the best model  */
+    info -> probw1_z = work.best[0] -> probw1_z;
+    info -> probw2_z = work.best[0] -> probw2_z;
+    info -> probz = work.best[0] -> probz;
+    info -> num_clusters = work.best[0] -> num_clusters;
+    info -> block_size = work.best[0] -> block_size;
+    info -> initial_clusters = work.best[0] -> initial_clusters;
+    info -> cluster_ids = work.best[0] -> cluster_ids;
+    info -> dead_iters = work.best[0] -> dead_iters;
+    info -> pruned = work.best[0] -> pruned;
+    info -> num_pruned = work.best[0] -> num_pruned;
+    info -> seed = work.best[0] -> seed;
+    info -> iterations = work.best[0] -> iterations;
+    info -> final_ML = work.best[0] -> final_ML;
+    info -> iter = work.best[0] -> iter;
+    wfree (work.best[0]);
+  }
+  else {
+    printSweep (info, work.best);
+    for (c = 0; c < info -> num_cluster_list; c++) {
+      printSweepModel (info, work.best[c]);
+      freeClone (work.best[c]);
+    }
+  }
+
+  wfree (threads);
+  wfree (work.best);
+  wfree (work.restarts);
+  wfree (work.order);
+
+  return;
+}
+
+
+bool run (INFO *info) {
+  struct timespec start;
+  struct timespec end;
+
+  GET_TIME (start);
+  (void) markWMalloc ();
+
+  /*  All processes read in co-occurrence data  */
+  if (!readCO (info)) {
+    /*  If there is an error, all processes are terminated  */
+    fprintf (stderr, "Error reading co-occurrence data.\n");
+    return false;
+  }
+  info -> readCO_peak = markWMalloc ();
+
+  if (info -> verbose) {
+    fprintf (stderr, "==\tm = %u; n = %u\n", info -> m, info -> n);
+  }
+
+  if ((info -> num_restarts > 1) || (info -> num_cluster_list > 1)) {
+    trainModels (info);
+  }
+  else {
+    allocateProbs (info);
+    initEM (info);
+    trainModel (info);
+  }
+  info -> train_peak = markWMalloc ();
+
+  /*  A sweep over the number of clusters has already written its models  */
+  if (info -> num_cluster_list == 1) {
+    if (info -> reorder != NULL) {
+      restoreOrder (info);
+    }
+    if (info -> dedup != NULL) {
+      expandProbs (info);
+    }
+    if (!info -> no_output) {
+      printCoProb (info);
+    }
+    printModel (info);
+    if (info -> prune_threshold > 0) {
+      printPruned (info);
+    }
   }
+  info -> output_peak = markWMalloc ();
 
-  time (&end);
-  info -> run_time += difftime (end, start);
+  GET_TIME (end);
+  info -> run_time += ELAPSED_TIME (start, end);
 
   return (true);
 }
@@ -21,6 +21,9 @@
 
 INFO *initialize ();
 void uninitialize (INFO *info);
+void allocateProbs (INFO *info);
+void freePosteriors (INFO *info);
+void freeProbs (INFO *info);
 bool run (INFO *info);
 
 #endif
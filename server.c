@@ -0,0 +1,727 @@
+/*
+**  Probabilistic latent semantic analysis (PLSA, baseline version)
+**  Copyright (C) 2009-2010  by Raymond Wan (r.wan@aist.go.jp)
+**
+**  This program is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  This program is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+**  Resident inference server.  A trained model is kept in memory and
+**  requests are accepted over a Unix domain socket, one per line:
+**
+**    SCORE <row id> <column id>                 log p(w2|w1)
+**    TOP <row id> <N>                           N columns with the highest p(w2|w1)
+**    FOLDIN <count> (<column id> <value>)+      log P(z|w1) of a new row
+**    QUIT                                       close the connection
+**
+**  Each reply is a single line starting with "OK" or "ERR".  Clients may
+**  send many requests at once; all complete lines that have arrived are
+**  answered together with one write.
+**
+**  One thread waits on every connection with poll () and hands those with
+**  complete lines to a pool of (info -> num_threads) workers, so that an
+**  idle connection does not hold a worker.  A signal wakes the polling
+**  thread through a pipe.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>                                  /*  UINT_MAX  */
+#include <stdbool.h>
+#include <stdarg.h>
+#include <math.h>
+#include <float.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "wmalloc.h"
+#include "plsa-defn.h"
+#include "input.h"
+#include "foldin.h"
+#include "server.h"
+
+
+/*!  Buffered reply for one connection  */
+typedef struct reply {
+  char *buf;
+  size_t len;
+  size_t size;
+} REPLY;
+
+
+/*!  One client connection; only the polling thread touches it unless it is busy  */
+typedef struct connection {
+  int fd;
+  /*!  Bytes received and not yet answered  */
+  char *in;
+  size_t in_len;
+  size_t in_size;
+  REPLY reply;
+  /*!  Handed to a worker, which has it until it is put on the done list  */
+  bool busy;
+  /*!  Close it when it is not busy:  the client sent QUIT or could not be written to  */
+  bool closing;
+  /*!  Next connection in the work queue or on the done list  */
+  struct connection *next;
+} CONNECTION;
+
+
+/*!  State shared by the polling thread and the workers  */
+typedef struct server {
+  INFO *info;
+  MODEL *model;
+  IDINDEX *row_index;
+  IDINDEX *column_index;
+  /*!  P(z|w1) of each row of the model, of size (m * k)  */
+  PROBNODE *probz_w1;
+  /*!  Listening socket  */
+  int listen_fd;
+  /*!  Open connections, owned by the polling thread  */
+  CONNECTION **conns;
+  unsigned int num_conns;
+  unsigned int max_conns;
+  /*!  Connections with complete lines to answer, and those answered;
+  **  both are protected by lock  */
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  CONNECTION *queue_head;
+  CONNECTION *queue_tail;
+  CONNECTION *done;
+  bool workers_stop;
+} SERVER;
+
+
+/*!  Set by a signal to shut the server down  */
+static volatile sig_atomic_t server_stop = 0;
+/*!  Pipe that wakes the polling thread:  written to by the signal handler
+**  and by a worker that has finished with a connection  */
+static int server_wake_fd[2] = { -1, -1 };
+
+
+/*!  Wake the polling thread; the pipe is non-blocking, so this never waits  */
+static void wakeServer (void) {
+  int saved_errno = errno;
+
+  if (write (server_wake_fd[1], "", 1) < 0) {
+    /*  The pipe is full, so the polling thread will wake anyway  */
+  }
+  errno = saved_errno;
+
+  return;
+}
+
+
+static void handler_stop (int sig) {
+  server_stop = 1;
+  wakeServer ();
+
+  return;
+}
+
+
+static void appendReply (REPLY *reply, const char *format, ...) {
+  va_list args;
+  int len = 0;
+
+  while (true) {
+    va_start (args, format);
+    len = vsnprintf (reply -> buf + reply -> len, reply -> size - reply -> len, format, args);
+    va_end (args);
+
+    if ((size_t) len < reply -> size - reply -> len) {
+      break;
+    }
+    reply -> size = (reply -> size + len) * 2;
+    reply -> buf = wrealloc (reply -> buf, reply -> size);
+  }
+  reply -> len += len;
+
+  return;
+}
+
+
+/*!  log p(w2|w1), summing over the clusters  */
+static PROBNODE scoreCell (SERVER *server, unsigned int i, unsigned int j) {
+  MODEL *model = server -> model;
+  unsigned int k = 0;
+  PROBNODE temp;
+
+  temp = server -> probz_w1[(size_t) i * model -> num_clusters] + model -> probw2_z[j];
+  for (k = 1; k < model -> num_clusters; k++) {
+    logSumsInline (temp, server -> probz_w1[(size_t) i * model -> num_clusters + k] + model -> probw2_z[(size_t) k * model -> n + j]);
+  }
+
+  return (temp);
+}
+
+
+/*!  Read an unsigned integer argument; false if it is missing or malformed  */
+static bool nextArgument (char **saveptr, unsigned int *value) {
+  char *token = strtok_r (NULL, " \t\r", saveptr);
+  char *end = NULL;
+
+  if (token == NULL) {
+    return false;
+  }
+  *value = (unsigned int) strtoul (token, &end, 10);
+
+  return (*end == '\0');
+}
+
+
+static void requestScore (SERVER *server, char **saveptr, REPLY *reply) {
+  unsigned int row_id;
+  unsigned int column_id;
+  unsigned int i;
+  unsigned int j;
+
+  if ((!nextArgument (saveptr, &row_id)) || (!nextArgument (saveptr, &column_id))) {
+    appendReply (reply, "ERR usage: SCORE <row id> <column id>\n");
+    return;
+  }
+  i = findIdentifier (server -> row_index, row_id);
+  j = findIdentifier (server -> column_index, column_id);
+  if ((i == UINT_MAX) || (j == UINT_MAX)) {
+    appendReply (reply, "ERR unknown row or column\n");
+    return;
+  }
+
+  appendReply (reply, "OK %.10f\n", scoreCell (server, i, j));
+
+  return;
+}
+
+
+static void requestTop (SERVER *server, char **saveptr, REPLY *reply) {
+  MODEL *model = server -> model;
+  unsigned int row_id;
+  unsigned int count;
+  unsigned int found = 0;
+  unsigned int *best_j = NULL;
+  PROBNODE *best = NULL;
+  PROBNODE temp;
+  unsigned int i;
+  unsigned int j;
+  unsigned int pos;
+
+  if ((!nextArgument (saveptr, &row_id)) || (!nextArgument (saveptr, &count))) {
+    appendReply (reply, "ERR usage: TOP <row id> <N>\n");
+    return;
+  }
+  i = findIdentifier (server -> row_index, row_id);
+  if (i == UINT_MAX) {
+    appendReply (reply, "ERR unknown row\n");
+    return;
+  }
+  if (count > model -> n) {
+    count = model -> n;
+  }
+
+  best = wmalloc ((count + 1) * sizeof (PROBNODE));
+  best_j = wmalloc ((count + 1) * sizeof (unsigned int));
+
+  /*  Insertion into a list sorted by decreasing score; N is expected to be small  */
+  for (j = 0; j < model -> n; j++) {
+    temp = scoreCell (server, i, j);
+    if ((found == count) && ((count == 0) || (temp <= best[count - 1]))) {
+      continue;
+    }
+    pos = (found < count) ? found++ : count - 1;
+    while ((pos > 0) && (best[pos - 1] < temp)) {
+      best[pos] = best[pos - 1];
+      best_j[pos] = best_j[pos - 1];
+      pos--;
+    }
+    best[pos] = temp;
+    best_j[pos] = j;
+  }
+
+  appendReply (reply, "OK %u", found);
+  for (pos = 0; pos < found; pos++) {
+    appendReply (reply, " %u %.10f", model -> column_ids[best_j[pos]], best[pos]);
+  }
+  appendReply (reply, "\n");
+
+  wfree (best);
+  wfree (best_j);
+
+  return;
+}
+
+
+static void requestFoldIn (SERVER *server, char **saveptr, REPLY *reply) {
+  MODEL *model = server -> model;
+  unsigned int count;
+  unsigned int column_id;
+  unsigned int value;
+  unsigned int found = 0;
+  unsigned int j;
+  unsigned int k;
+  unsigned int pos;
+  COOCCUR *row = NULL;
+  PROBNODE *probz_w1 = NULL;
+  PROBNODE *scratch = NULL;
+
+  if (!nextArgument (saveptr, &count)) {
+    appendReply (reply, "ERR usage: FOLDIN <count> (<column id> <value>)+\n");
+    return;
+  }
+  /*  The count comes from the client; check it before allocating for it  */
+  if (count > SERVER_MAX_PAIRS) {
+    appendReply (reply, "ERR at most %u (column id, value) pairs\n", SERVER_MAX_PAIRS);
+    return;
+  }
+
+  row = wmalloc (((size_t) count + 1) * sizeof (COOCCUR));
+  for (pos = 0; pos < count; pos++) {
+    if ((!nextArgument (saveptr, &column_id)) || (!nextArgument (saveptr, &value))) {
+      appendReply (reply, "ERR expected %u (column id, value) pairs\n", count);
+      wfree (row);
+      return;
+    }
+    j = findIdentifier (server -> column_index, column_id);
+    /*  Unknown columns and zero values carry no information  */
+    if ((j == UINT_MAX) || (value == 0)) {
+      continue;
+    }
+    found++;
+    row[found].column = j;
+    row[found].x = DOLOG (value);
+  }
+  row[0].column = found;
+  row[0].x = 0.0;
+
+  probz_w1 = wmalloc (model -> num_clusters * sizeof (PROBNODE));
+  scratch = wmalloc (2 * model -> num_clusters * sizeof (PROBNODE));
+  (void) foldInRow (model, server -> info -> maxiter, row, NULL, probz_w1, scratch);
+
+  appendReply (reply, "OK %u", model -> num_clusters);
+  for (k = 0; k < model -> num_clusters; k++) {
+    appendReply (reply, " %.10f", probz_w1[k]);
+  }
+  appendReply (reply, "\n");
+
+  wfree (row);
+  wfree (probz_w1);
+  wfree (scratch);
+
+  return;
+}
+
+
+/*!  Answer a single request line; returns false if the client asked to quit  */
+static bool handleRequest (SERVER *server, char *line, REPLY *reply) {
+  char *saveptr = NULL;
+  char *command = strtok_r (line, " \t\r", &saveptr);
+
+  if (command == NULL) {
+    return true;
+  }
+
+  if (strcmp (command, "SCORE") == 0) {
+    requestScore (server, &saveptr, reply);
+  }
+  else if (strcmp (command, "TOP") == 0) {
+    requestTop (server, &saveptr, reply);
+  }
+  else if (strcmp (command, "FOLDIN") == 0) {
+    requestFoldIn (server, &saveptr, reply);
+  }
+  else if (strcmp (command, "QUIT") == 0) {
+    return false;
+  }
+  else {
+    appendReply (reply, "ERR unknown request %s\n", command);
+  }
+
+  return true;
+}
+
+
+/*!  Write all of a buffer, retrying on short writes  */
+static bool writeAll (int fd, const char *buf, size_t len) {
+  ssize_t written = 0;
+
+  while (len > 0) {
+    written = write (fd, buf, len);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    buf += written;
+    len -= written;
+  }
+
+  return true;
+}
+
+
+/*!
+**  Answer every complete line received on a connection as a single batch,
+**  with one write.  Run by a worker.
+*/
+static void answerConnection (SERVER *server, CONNECTION *conn) {
+  char *line = conn -> in;
+  char *newline = NULL;
+
+  conn -> reply.len = 0;
+  while ((!conn -> closing) && ((newline = memchr (line, '\n', conn -> in_len - (line - conn -> in))) != NULL)) {
+    *newline = '\0';
+    conn -> closing = !handleRequest (server, line, &(conn -> reply));
+    line = newline + 1;
+  }
+  conn -> in_len -= (line - conn -> in);
+  memmove (conn -> in, line, conn -> in_len);
+
+  if ((conn -> reply.len > 0) && (!writeAll (conn -> fd, conn -> reply.buf, conn -> reply.len))) {
+    conn -> closing = true;
+  }
+
+  return;
+}
+
+
+static void *serverWorker (void *arg) {
+  SERVER *server = (SERVER*) arg;
+  CONNECTION *conn = NULL;
+
+  while (true) {
+    pthread_mutex_lock (&(server -> lock));
+    while ((server -> queue_head == NULL) && (!server -> workers_stop)) {
+      pthread_cond_wait (&(server -> ready), &(server -> lock));
+    }
+    conn = server -> queue_head;
+    if (conn != NULL) {
+      server -> queue_head = conn -> next;
+      if (server -> queue_head == NULL) {
+        server -> queue_tail = NULL;
+      }
+    }
+    pthread_mutex_unlock (&(server -> lock));
+    if (conn == NULL) {
+      break;
+    }
+
+    answerConnection (server, conn);
+
+    pthread_mutex_lock (&(server -> lock));
+    conn -> next = server -> done;
+    server -> done = conn;
+    pthread_mutex_unlock (&(server -> lock));
+    wakeServer ();
+  }
+
+  return (NULL);
+}
+
+
+/*!  Accept a new connection and add it to those polled  */
+static void acceptConnection (SERVER *server) {
+  CONNECTION *conn = NULL;
+  struct timeval timeout;
+  int fd = accept (server -> listen_fd, NULL, NULL);
+
+  if (fd < 0) {
+    return;
+  }
+
+  /*  A client that stops reading cannot hold a worker for long  */
+  timeout.tv_sec = SERVER_WRITE_TIMEOUT;
+  timeout.tv_usec = 0;
+  (void) setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+
+  conn = wmalloc (sizeof (CONNECTION));
+  conn -> fd = fd;
+  conn -> in_size = SERVER_BUFSIZE;
+  conn -> in_len = 0;
+  conn -> in = wmalloc (conn -> in_size);
+  conn -> reply.size = SERVER_BUFSIZE;
+  conn -> reply.len = 0;
+  conn -> reply.buf = wmalloc (conn -> reply.size);
+  conn -> busy = false;
+  conn -> closing = false;
+  conn -> next = NULL;
+
+  if (server -> num_conns == server -> max_conns) {
+    server -> max_conns = (server -> max_conns == 0) ? 16 : 2 * server -> max_conns;
+    server -> conns = wrealloc (server -> conns, server -> max_conns * sizeof (CONNECTION*));
+  }
+  server -> conns[server -> num_conns++] = conn;
+
+  return;
+}
+
+
+/*!
+**  Read what has arrived on a connection and, once it holds a complete
+**  line, queue it for the workers.  Returns false if the connection
+**  should be closed.
+*/
+static bool readConnection (SERVER *server, CONNECTION *conn) {
+  ssize_t got = 0;
+
+  /*  Grow the buffer if a single request does not fit, up to a limit  */
+  if (conn -> in_len == conn -> in_size) {
+    if (conn -> in_size >= SERVER_MAX_REQUEST) {
+      (void) writeAll (conn -> fd, "ERR request too long\n", 21);
+      return false;
+    }
+    conn -> in_size *= 2;
+    conn -> in = wrealloc (conn -> in, conn -> in_size);
+  }
+  got = read (conn -> fd, conn -> in + conn -> in_len, conn -> in_size - conn -> in_len);
+  if ((got < 0) && (errno == EINTR)) {
+    return true;
+  }
+  if (got <= 0) {
+    return false;
+  }
+  conn -> in_len += got;
+
+  /*  Earlier lines have all been answered, so only the new bytes can end one  */
+  if (memchr (conn -> in + conn -> in_len - got, '\n', got) != NULL) {
+    conn -> busy = true;
+    conn -> next = NULL;
+    pthread_mutex_lock (&(server -> lock));
+    if (server -> queue_tail == NULL) {
+      server -> queue_head = conn;
+    }
+    else {
+      server -> queue_tail -> next = conn;
+    }
+    server -> queue_tail = conn;
+    pthread_cond_signal (&(server -> ready));
+    pthread_mutex_unlock (&(server -> lock));
+  }
+
+  return true;
+}
+
+
+static void closeConnection (CONNECTION *conn) {
+  close (conn -> fd);
+  wfree (conn -> in);
+  wfree (conn -> reply.buf);
+  wfree (conn);
+
+  return;
+}
+
+
+/*!
+**  Wait on the wake-up pipe, the listening socket and every connection
+**  that is not with a worker, until a signal stops the server.
+*/
+static void pollConnections (SERVER *server) {
+  struct pollfd *fds = NULL;
+  unsigned int max_fds = 0;
+  unsigned int num_polled = 0;
+  unsigned int c = 0;
+  unsigned int kept = 0;
+  CONNECTION *conn = NULL;
+  char drain[64];
+
+  while (!server_stop) {
+    num_polled = server -> num_conns;
+    if (num_polled + 2 > max_fds) {
+      max_fds = 2 * (num_polled + 2);
+      fds = wrealloc (fds, max_fds * sizeof (struct pollfd));
+    }
+    fds[0].fd = server_wake_fd[0];
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = server -> listen_fd;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    for (c = 0; c < num_polled; c++) {
+      /*  poll () skips negative descriptors, so busy connections are left alone  */
+      fds[c + 2].fd = (server -> conns[c] -> busy) ? -1 : server -> conns[c] -> fd;
+      fds[c + 2].events = POLLIN;
+      fds[c + 2].revents = 0;
+    }
+
+    if (poll (fds, num_polled + 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    /*  Take back the connections the workers have answered  */
+    if (fds[0].revents != 0) {
+      while (read (server_wake_fd[0], drain, sizeof (drain)) > 0) {
+      }
+      pthread_mutex_lock (&(server -> lock));
+      for (conn = server -> done; conn != NULL; conn = conn -> next) {
+        conn -> busy = false;
+      }
+      server -> done = NULL;
+      pthread_mutex_unlock (&(server -> lock));
+    }
+
+    for (c = 0; c < num_polled; c++) {
+      conn = server -> conns[c];
+      /*  Once queued, the connection is the worker's, so only a failed read is recorded  */
+      if ((fds[c + 2].revents != 0) && (!conn -> busy) && (!conn -> closing) && (!readConnection (server, conn))) {
+        conn -> closing = true;
+      }
+    }
+
+    kept = 0;
+    for (c = 0; c < server -> num_conns; c++) {
+      conn = server -> conns[c];
+      if ((!conn -> busy) && (conn -> closing)) {
+        closeConnection (conn);
+      }
+      else {
+        server -> conns[kept++] = conn;
+      }
+    }
+    server -> num_conns = kept;
+
+    if ((fds[1].revents & POLLIN) != 0) {
+      acceptConnection (server);
+    }
+  }
+
+  wfree (fds);
+
+  return;
+}
+
+
+/*!
+**  Load the model and serve requests on the Unix domain socket until
+**  interrupted.  This thread polls the connections and the workers
+**  answer them; on a signal, the requests already queued are answered
+**  before every connection is closed.
+*/
+bool runServer (INFO *info) {
+  SERVER server;
+  MODEL *model = NULL;
+  struct sockaddr_un addr;
+  pthread_t *threads = NULL;
+  unsigned int num_clusters = 0;
+  unsigned int i = 0;
+  unsigned int k = 0;
+  PROBNODE sum;
+
+  server.info = info;
+  server.model = model = readModel (info, info -> model_fn);
+  num_clusters = model -> num_clusters;
+  server.row_index = createIdIndex (model -> row_ids, model -> m);
+  server.column_index = createIdIndex (model -> column_ids, model -> n);
+
+  /*  P(z|w1) is proportional to P(z) P(w1|z)  */
+  server.probz_w1 = wmalloc ((size_t) model -> m * num_clusters * sizeof (PROBNODE));
+  for (i = 0; i < model -> m; i++) {
+    for (k = 0; k < num_clusters; k++) {
+      server.probz_w1[(size_t) i * num_clusters + k] = model -> probz[k] + model -> probw1_z[(size_t) k * model -> m + i];
+    }
+    sum = server.probz_w1[(size_t) i * num_clusters];
+    for (k = 1; k < num_clusters; k++) {
+      logSumsInline (sum, server.probz_w1[(size_t) i * num_clusters + k]);
+    }
+    for (k = 0; k < num_clusters; k++) {
+      server.probz_w1[(size_t) i * num_clusters + k] -= sum;
+    }
+  }
+
+  if (strlen (info -> socket_fn) >= sizeof (addr.sun_path)) {
+    fprintf (stderr, "Socket path %s is too long.\n", info -> socket_fn);
+    exit (EXIT_FAILURE);
+  }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, info -> socket_fn);
+
+  server.listen_fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  unlink (info -> socket_fn);
+  if ((server.listen_fd < 0) || (bind (server.listen_fd, (struct sockaddr*) &addr, sizeof (addr)) != 0) || (listen (server.listen_fd, SERVER_BACKLOG) != 0)) {
+    fprintf (stderr, "Error listening on socket %s.\n", info -> socket_fn);
+    exit (EXIT_FAILURE);
+  }
+
+  if (pipe (server_wake_fd) != 0) {
+    fprintf (stderr, "Error creating the server's wake-up pipe.\n");
+    exit (EXIT_FAILURE);
+  }
+  (void) fcntl (server_wake_fd[0], F_SETFL, O_NONBLOCK);
+  (void) fcntl (server_wake_fd[1], F_SETFL, O_NONBLOCK);
+  server.conns = NULL;
+  server.num_conns = 0;
+  server.max_conns = 0;
+  server.queue_head = NULL;
+  server.queue_tail = NULL;
+  server.done = NULL;
+  server.workers_stop = false;
+  pthread_mutex_init (&(server.lock), NULL);
+  pthread_cond_init (&(server.ready), NULL);
+
+  signal (SIGINT, handler_stop);
+  signal (SIGTERM, handler_stop);
+  signal (SIGPIPE, SIG_IGN);
+
+  if (info -> verbose) {
+    fprintf (stderr, "==\tServing on socket:                              %s\n", info -> socket_fn);
+  }
+
+  threads = wmalloc (info -> num_threads * sizeof (pthread_t));
+  for (i = 0; i < info -> num_threads; i++) {
+    pthread_create (&(threads[i]), NULL, serverWorker, &server);
+  }
+
+  pollConnections (&server);
+
+  PROGRESS_MSG ("Server shutting down...");
+
+  /*  The workers answer what is queued and then exit  */
+  pthread_mutex_lock (&(server.lock));
+  server.workers_stop = true;
+  pthread_cond_broadcast (&(server.ready));
+  pthread_mutex_unlock (&(server.lock));
+  for (i = 0; i < info -> num_threads; i++) {
+    pthread_join (threads[i], NULL);
+  }
+
+  for (i = 0; i < server.num_conns; i++) {
+    closeConnection (server.conns[i]);
+  }
+  wfree (server.conns);
+  pthread_mutex_destroy (&(server.lock));
+  pthread_cond_destroy (&(server.ready));
+  close (server_wake_fd[0]);
+  close (server_wake_fd[1]);
+  close (server.listen_fd);
+  unlink (info -> socket_fn);
+
+  wfree (threads);
+  wfree (server.probz_w1);
+  freeIdIndex (server.row_index);
+  freeIdIndex (server.column_index);
+  freeModel (model);
+
+  return (true);
+}
+
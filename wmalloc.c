@@ -16,206 +16,280 @@
 **  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+/*!
+**  Allocation with accounting.  Each block starts with a WMHEADER that
+**  records its size and the subsystem it was allocated for, so freeing
+**  it needs no lookup.  The bytes in use and the largest number in use
+**  at once are kept in total and per subsystem, in 64-bit counters that
+**  are updated atomically so that threads can allocate concurrently.
+**
+**  Once configureWMalloc () has asked for huge pages or interleaving,
+**  blocks of at least WM_LARGE_SIZE bytes are mapped directly instead of
+**  coming from malloc (), so that their pages can be chosen:  transparent
+**  huge pages are requested with madvise (), explicit ones with
+**  MAP_HUGETLB (falling back to normal pages if none are reserved), and
+**  interleaving over the NUMA nodes allowed to the process with mbind ().
+*/
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined (__linux__)
+#include <linux/mempolicy.h>
+#endif
 
 #include "wmalloc.h"
 
-static unsigned int inuse_malloc = 0;
-static unsigned int max_malloc = 0;
-static WMSTRUCT **wm_array;
-static char *tempstr;
+/*!  Largest number of NUMA nodes handled by interleaving  */
+#define WM_MAX_NODES 1024
+#define WM_MASK_BITS (8 * sizeof (unsigned long))
 
-void *wmalloc (size_t y_arg) {
-  void *x_arg = malloc (y_arg);
-  if (x_arg == NULL) {
-    fprintf (stderr, "Error in malloc while allocating %u bytes in [%s, %u].\n", (unsigned int) y_arg, __FILE__, __LINE__);
-    exit (EXIT_FAILURE);
-  }
-#ifdef COUNT_MALLOC
-  countMalloc (x_arg, y_arg, __FILE__, __LINE__);
-#endif
+static const char *tag_names[WM_NUM_TAGS] = { "other", "cooccur", "model", "posterior", "index", "engine" };
 
-  return (x_arg);
-}
+static size_t inuse_malloc = 0;
+static size_t max_malloc = 0;
+/*!  Largest number of bytes in use since the last call to markWMalloc ()  */
+static size_t mark_malloc = 0;
+static size_t inuse_tag[WM_NUM_TAGS];
+static size_t max_tag[WM_NUM_TAGS];
 
+static unsigned int large_pages = WM_PAGES_DEFAULT;
+static bool large_interleave = false;
+/*!  Nodes that large blocks are interleaved over  */
+static unsigned long node_mask[WM_MAX_NODES / WM_MASK_BITS];
+static bool hugetlb_warned = false;
 
-void *wrealloc (void *x_arg, size_t y_arg) {
-#ifdef COUNT_MALLOC
-  countFree ((void*) x_arg);
-#endif
-  x_arg = realloc (x_arg, y_arg);
 
-  if (x_arg == NULL) {
-    fprintf (stderr, "Error in realloc while allocating %u bytes in [%s, %u].\n", (unsigned int) y_arg, __FILE__, __LINE__);
-    exit (EXIT_FAILURE);
+/*!  Raise *max to value if it is lower  */
+static void raiseMax (size_t *max, size_t value) {
+  size_t curr = __atomic_load_n (max, __ATOMIC_RELAXED);
+
+  while ((value > curr) && (!__atomic_compare_exchange_n (max, &curr, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))) {
   }
-#ifdef COUNT_MALLOC
-  countMalloc ((void*) x_arg, y_arg, __FILE__, __LINE__);
-#endif
 
-  return (x_arg);
+  return;
 }
 
-void wfree (void *x_arg) {
-#ifdef COUNT_MALLOC
-  countFree (x_arg);
-#endif
-  free (x_arg);
-}
 
-/*  Function adapted from Algorithms in C (Third edition) by Robert Sedgewick
-**  (page 578) */
-static unsigned int hash (char *v, signed int M) {
-  signed int h = 0;
-  signed int a = 127;
+static void countMalloc (WMHEADER *header) {
+  size_t inuse = __atomic_add_fetch (&inuse_malloc, header -> size, __ATOMIC_RELAXED);
+  size_t inuse_t = __atomic_add_fetch (&(inuse_tag[header -> tag]), header -> size, __ATOMIC_RELAXED);
 
-  /*  Skip the 0x at the beginning  */
-  v += 2;
-  for (; *v != '\0'; v++) {
-    h = (a*h + (signed int) *v) % M;
-  }
+  raiseMax (&max_malloc, inuse);
+  raiseMax (&mark_malloc, inuse);
+  raiseMax (&(max_tag[header -> tag]), inuse_t);
 
-  return ((unsigned int) h);
+  return;
 }
 
-void initWMalloc () {
-  WMSTRUCT *node = NULL;
-  unsigned int i = 0;
 
-  inuse_malloc = 0;
-  max_malloc = 0;
+static void countFree (WMHEADER *header) {
+  __atomic_sub_fetch (&inuse_malloc, header -> size, __ATOMIC_RELAXED);
+  __atomic_sub_fetch (&(inuse_tag[header -> tag]), header -> size, __ATOMIC_RELAXED);
+
+  return;
+}
 
-  tempstr = malloc (sizeof (char) * TEMPSTRLEN);
 
-  wm_array = malloc (sizeof (WMSTRUCT*) * WM_SIZE);
-  for (i = 0; i < WM_SIZE; i++) {
-    /*  Add sentinel  */
-    node = malloc (sizeof (WMSTRUCT));
-    node -> ptr = NULL;
-    node -> size = 0;
-    node -> file = NULL;
-    node -> line = 0;
-    node -> next = NULL;
-    wm_array[i] = node;
+/*!
+**  Choose the pages of blocks of at least WM_LARGE_SIZE bytes allocated
+**  from now on (WM_PAGES_*) and whether to interleave them over the NUMA
+**  nodes.  Returns without interleaving if the nodes cannot be found.
+*/
+void configureWMalloc (unsigned int pages, bool interleave) {
+  large_pages = pages;
+  large_interleave = false;
+#if defined (SYS_get_mempolicy) && defined (SYS_mbind)
+  if (interleave) {
+    memset (node_mask, 0, sizeof (node_mask));
+    if (syscall (SYS_get_mempolicy, NULL, node_mask, WM_MAX_NODES, NULL, MPOL_F_MEMS_ALLOWED) == 0) {
+      large_interleave = true;
+    }
+    else {
+      fprintf (stderr, "==\tWarning:  NUMA nodes not available; memory is not interleaved.\n");
+    }
+  }
+#else
+  if (interleave) {
+    fprintf (stderr, "==\tWarning:  NUMA interleaving is not supported on this system.\n");
   }
+#endif
 
   return;
 }
 
 
-void printWMalloc () {
-  WMSTRUCT *prev = NULL;
-  WMSTRUCT *curr = NULL;
-  unsigned int i = 0;
+/*!  Bytes mapped for a block of y_arg bytes  */
+static size_t mappedLength (size_t y_arg, unsigned int mapped) {
+  size_t page = (mapped == WM_MAPPED_HUGETLB) ? WM_HUGE_PAGE_SIZE : (size_t) sysconf (_SC_PAGESIZE);
+
+  return ((WM_HEADER_SIZE + y_arg + page - 1) / page * page);
+}
 
-  fprintf (stderr, "\tMemory used at exit:  %u\n", inuse_malloc);
-  fprintf (stderr, "\tMaximum memory used at once:  %u\n", max_malloc);
-  fprintf (stderr, "\tMaximum memory (MB):  %.1f\n", (double) max_malloc / (double) (1024 * 1024));
 
-  for (i = 0; i < WM_SIZE; i++) {
-    prev = NULL;
-    curr = wm_array[i];
+static WMHEADER *mapBlock (size_t y_arg) {
+  void *block = MAP_FAILED;
+  size_t length = 0;
+  unsigned int mapped = WM_MAPPED_PAGES;
 
-    while (curr != NULL) {
-      prev = curr;
-      curr = curr -> next;
-      free (prev -> file);
-      free (prev);
+#if defined (MAP_HUGETLB)
+  if (large_pages == WM_PAGES_EXPLICIT) {
+    length = mappedLength (y_arg, WM_MAPPED_HUGETLB);
+    block = mmap (NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (block != MAP_FAILED) {
+      mapped = WM_MAPPED_HUGETLB;
     }
+    else if (!__atomic_exchange_n (&hugetlb_warned, true, __ATOMIC_RELAXED)) {
+      fprintf (stderr, "==\tWarning:  No huge pages reserved (see /proc/sys/vm/nr_hugepages); using normal pages.\n");
+    }
+  }
+#endif
+  if (block == MAP_FAILED) {
+    length = mappedLength (y_arg, WM_MAPPED_PAGES);
+    block = mmap (NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED) {
+      fprintf (stderr, "Error in mmap while allocating %zu bytes.\n", y_arg);
+      exit (EXIT_FAILURE);
+    }
+#if defined (MADV_HUGEPAGE)
+    if (large_pages == WM_PAGES_TRANSPARENT) {
+      (void) madvise (block, length, MADV_HUGEPAGE);
+    }
+#endif
+  }
+#if defined (SYS_mbind)
+  /*  Pages are placed when first touched, so this is before any write  */
+  if (large_interleave) {
+    (void) syscall (SYS_mbind, block, length, MPOL_INTERLEAVE, node_mask, WM_MAX_NODES, 0);
   }
+#endif
 
-  free (tempstr);
-  free (wm_array);
+  ((WMHEADER*) block) -> mapped = mapped;
 
-  return;
+  return ((WMHEADER*) block);
 }
 
 
-void printInUseWMalloc (void) {
-  unsigned int i = 0;
-  WMSTRUCT *curr = NULL;
+void *wmallocTag (size_t y_arg, unsigned int tag) {
+  WMHEADER *header = NULL;
 
-  for (i = 0; i < WM_SIZE; i++) {
-    if (wm_array[i] -> ptr != NULL) {
-      curr = wm_array[i];
-      while (curr -> ptr != NULL) {
-        fprintf (stderr, "%p\t(%u)\t[%s]\t[%u]\n", curr -> ptr, (unsigned int) curr -> size, curr -> file, curr -> line);
-        curr = curr -> next;
-      }
+  if ((y_arg >= WM_LARGE_SIZE) && ((large_pages != WM_PAGES_DEFAULT) || (large_interleave))) {
+    header = mapBlock (y_arg);
+  }
+  else {
+    header = malloc (WM_HEADER_SIZE + y_arg);
+    if (header == NULL) {
+      fprintf (stderr, "Error in malloc while allocating %zu bytes.\n", y_arg);
+      exit (EXIT_FAILURE);
     }
+    header -> mapped = WM_MAPPED_NONE;
   }
+  header -> size = y_arg;
+  header -> tag = (tag < WM_NUM_TAGS) ? tag : WM_TAG_OTHER;
+  countMalloc (header);
 
-  return;
+  return ((char*) header + WM_HEADER_SIZE);
 }
 
 
-void countMalloc (void *ptr, size_t amount, const char *file, const unsigned int line) {
-  WMSTRUCT *node = NULL;
-  unsigned int pos = 0;
-
-  node = malloc (sizeof (WMSTRUCT));
-  node -> ptr = ptr;
-  node -> size = amount;
-  node -> file = malloc (sizeof (char) * (strlen (file) + 1));
-  node -> file = strcpy (node -> file, file);
-  node -> line = line;
-
-  (void) snprintf (tempstr, TEMPSTRLEN, "%p", ptr);
-  pos = hash (tempstr, WM_SIZE);
-  node -> next = wm_array[pos];
-  wm_array[pos] = node;
-
-  inuse_malloc += amount;
-
-  if (inuse_malloc > max_malloc) {
-    max_malloc = inuse_malloc;
-  }
-
-  return;
+void *wmalloc (size_t y_arg) {
+  return (wmallocTag (y_arg, WM_TAG_OTHER));
 }
 
 
-void countFree (void *ptr) {
-  WMSTRUCT *prev = NULL;
-  WMSTRUCT *curr = NULL;
-  unsigned int pos = 0;
+/*!  The block keeps the subsystem it was first allocated for  */
+void *wrealloc (void *x_arg, size_t y_arg) {
+  WMHEADER *header = NULL;
+  void *block = NULL;
 
-  (void) snprintf (tempstr, TEMPSTRLEN, "%p", ptr);
-  pos = hash (tempstr, WM_SIZE);
+  if (x_arg == NULL) {
+    return (wmalloc (y_arg));
+  }
 
-  /*  Locate the node  */
-  curr = wm_array[pos];
-  while (curr -> ptr != NULL) {
-    if (curr -> ptr == ptr) {
-      break;
-    }
-    prev = curr;
-    curr = curr -> next;
+  header = (WMHEADER*) ((char*) x_arg - WM_HEADER_SIZE);
+  /*  Mapped blocks, or blocks that become large, are moved  */
+  if ((header -> mapped != WM_MAPPED_NONE) || ((y_arg >= WM_LARGE_SIZE) && ((large_pages != WM_PAGES_DEFAULT) || (large_interleave)))) {
+    block = wmallocTag (y_arg, header -> tag);
+    memcpy (block, x_arg, (header -> size < y_arg) ? header -> size : y_arg);
+    wfree (x_arg);
+    return (block);
   }
-  if (curr -> ptr == NULL) {
-    fprintf (stderr, "(F) Fatal error.  Node %p could not be found.\n", ptr);
+
+  countFree (header);
+  header = realloc (header, WM_HEADER_SIZE + y_arg);
+  if (header == NULL) {
+    fprintf (stderr, "Error in realloc while allocating %zu bytes.\n", y_arg);
     exit (EXIT_FAILURE);
   }
+  header -> size = y_arg;
+  countMalloc (header);
+
+  return ((char*) header + WM_HEADER_SIZE);
+}
+
 
-  inuse_malloc -= curr -> size;
+void wfree (void *x_arg) {
+  WMHEADER *header = NULL;
 
-  if (inuse_malloc > max_malloc) {
-    max_malloc = inuse_malloc;
+  if (x_arg == NULL) {
+    return;
   }
 
-  /*  Remove the node  */
-  if (prev == NULL) {
-    wm_array[pos] = curr -> next;
+  header = (WMHEADER*) ((char*) x_arg - WM_HEADER_SIZE);
+  countFree (header);
+  if (header -> mapped != WM_MAPPED_NONE) {
+    munmap (header, mappedLength (header -> size, header -> mapped));
   }
   else {
-    prev -> next = curr -> next;
+    free (header);
   }
-  free (curr -> file);
-  free (curr);
 
   return;
 }
 
 
+size_t inUseWMalloc (void) {
+  return (__atomic_load_n (&inuse_malloc, __ATOMIC_RELAXED));
+}
+
+
+size_t peakWMalloc (void) {
+  return (__atomic_load_n (&max_malloc, __ATOMIC_RELAXED));
+}
+
+
+size_t peakTagWMalloc (unsigned int tag) {
+  return (__atomic_load_n (&(max_tag[tag]), __ATOMIC_RELAXED));
+}
+
+
+const char *tagNameWMalloc (unsigned int tag) {
+  return (tag_names[tag]);
+}
+
+
+/*!
+**  Return the largest number of bytes in use at once since the previous
+**  call (or the start) and start counting again from the bytes in use
+**  now; calls around a phase give its peak footprint.
+*/
+size_t markWMalloc (void) {
+  return (__atomic_exchange_n (&mark_malloc, inUseWMalloc (), __ATOMIC_RELAXED));
+}
+
+
+void printWMalloc (void) {
+  unsigned int tag = 0;
+
+  fprintf (stderr, "==\tMemory in use at exit:                          %zu bytes\n", inUseWMalloc ());
+  fprintf (stderr, "==\tMaximum memory in use at once:                  %.1f MB\n", (double) peakWMalloc () / (1024 * 1024));
+  for (tag = 0; tag < WM_NUM_TAGS; tag++) {
+    fprintf (stderr, "==\t  %-10s                                    %.1f MB\n", tag_names[tag], (double) peakTagWMalloc (tag) / (1024 * 1024));
+  }
+
+  return;
+}
@@ -19,26 +19,48 @@
 #ifndef WMALLOC_H
 #define WMALLOC_H
 
-#define WM_SIZE 65536
-#define TEMPSTRLEN 80
+/*!  Subsystems that allocations are counted under  */
+#define WM_TAG_OTHER 0
+#define WM_TAG_COOCCUR 1
+#define WM_TAG_MODEL 2
+#define WM_TAG_POSTERIOR 3
+#define WM_TAG_INDEX 4
+#define WM_TAG_ENGINE 5
+#define WM_NUM_TAGS 6
 
-typedef struct wmstruct {
-  void *ptr;
+/*!  Bytes in front of each allocation; a multiple of the alignment of malloc ()  */
+#define WM_HEADER_SIZE 16
+
+/*!  Pages for blocks of at least WM_LARGE_SIZE bytes (see configureWMalloc ())  */
+#define WM_PAGES_DEFAULT 0
+#define WM_PAGES_TRANSPARENT 1
+#define WM_PAGES_EXPLICIT 2
+#define WM_LARGE_SIZE (2 * 1024 * 1024)
+#define WM_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/*!  How a block was allocated  */
+#define WM_MAPPED_NONE 0
+#define WM_MAPPED_PAGES 1
+#define WM_MAPPED_HUGETLB 2
+
+typedef struct wmheader {
   size_t size;
-  char *file;
-  unsigned int line;
-  struct wmstruct *next;
-} WMSTRUCT;
+  unsigned short tag;
+  /*!  WM_MAPPED_NONE if from malloc (), otherwise from mmap ()  */
+  unsigned short mapped;
+} WMHEADER;
 
+void configureWMalloc (unsigned int pages, bool interleave);
 void *wmalloc (size_t y_arg);
+void *wmallocTag (size_t y_arg, unsigned int tag);
 void *wrealloc (void *x_arg, size_t y_arg);
 void wfree (void *x_arg);
 
-void initWMalloc (void);
+size_t inUseWMalloc (void);
+size_t peakWMalloc (void);
+size_t peakTagWMalloc (unsigned int tag);
+const char *tagNameWMalloc (unsigned int tag);
+size_t markWMalloc (void);
 void printWMalloc (void);
-void printInUseWMalloc (void);
-void countMalloc (void *ptr, size_t amount, const char *file, unsigned int line);
-void countFree (void *ptr);
 
 #endif
-